@@ -0,0 +1,77 @@
+#include <vector>
+#include <string>
+#include <filesystem>
+
+#include <clu/text/print.h>
+#include <clu/parse.h>
+#include <clu/random.h>
+
+#include <fluorine/arena/random_player.h>
+#include <fluorine/evaluation/linear_pattern_evaluator.h>
+#include <fluorine/evaluation/probcut.h>
+
+namespace
+{
+    const std::string help = //
+        R"(Usage: probcut_calibration <model> <output> [positions] [depth]
+    <model>     path of the evaluator weights
+    <output>    path to save the fitted parameters to
+    [positions] number of random positions to search, 1000 by default
+    [depth]     maximum depth to calibrate, 12 by default)";
+
+    std::vector<flr::GameState> random_positions(const std::size_t count)
+    {
+        std::vector<flr::GameState> res;
+        res.reserve(count);
+        std::uniform_int_distribution<int> moves_dist(0, 50);
+        flr::RandomPlayer player;
+        while (res.size() < count)
+        {
+            flr::GameState state;
+            const int moves = moves_dist(clu::thread_rng());
+            for (int i = 0; i < moves; i++)
+                state.play(player.get_move(state));
+            // Skip finished games
+            if (state.legal_moves == 0 && state.play_copied(flr::Coords::none).legal_moves == 0)
+                continue;
+            res.push_back(state);
+        }
+        return res;
+    }
+} // namespace
+
+int main(const int argc, const char* argv[])
+try
+{
+    if (argc < 3 || argc > 5)
+        throw std::runtime_error(help);
+    const std::filesystem::path model_path = argv[1];
+    if (!exists(model_path))
+        throw std::runtime_error(std::format("File does not exist: {}", model_path.string()));
+    const auto count = argc > 3 ? clu::parse<std::size_t>(argv[3]) : std::optional<std::size_t>(1000);
+    const auto depth = argc > 4 ? clu::parse<int>(argv[4]) : std::optional<int>(12);
+    if (!count || !depth || *depth < 4)
+        throw std::runtime_error(help);
+
+    const auto eval = flr::LinearPatternEvaluator::load(model_path);
+    const auto positions = random_positions(*count);
+    const auto params = flr::calibrate_probcut(*eval, positions, {.max_depth = *depth});
+    for (std::size_t stage = 0; stage < params.stages(); stage++)
+        for (int d = params.min_depth(); d <= params.max_depth(); d++)
+            for (std::size_t check = 0; check < params.checks(); check++)
+            {
+                const int shallow_depth = flr::ProbCutParameters::shallow_depth(d, check);
+                if (shallow_depth < 0)
+                    break;
+                const auto [slope, intercept, sigma] = params.regression(stage, d, check);
+                clu::println("stage {:2} depth {:2} <- {:2}: slope {:.3f} intercept {:.3f} sigma {:.3f}", stage, d,
+                    shallow_depth, slope, intercept, sigma);
+            }
+    params.save(std::filesystem::path(argv[2]));
+    return 0;
+}
+catch (const std::exception& e)
+{
+    clu::println("Error due to exception:\n{}", e.what());
+    return 1;
+}
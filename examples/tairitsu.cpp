@@ -66,6 +66,12 @@ namespace
                     report_state();
                 else if (cmd == "load")
                     try_invoke_command(&Game::load_model, line_sv);
+                else if (cmd == "time")
+                    try_invoke_command(&Game::set_time_limit, line_sv);
+                else if (cmd == "probcut")
+                    try_invoke_command(&Game::load_probcut, line_sv);
+                else if (cmd == "threads")
+                    try_invoke_command(&Game::set_thread_count, line_sv);
                 else if (cmd == "play")
                     try_invoke_command(&Game::play, line_sv);
                 else if (cmd == "suggest")
@@ -128,6 +134,37 @@ namespace
             std::cout << std::format("loaded {}\n", path) << std::flush;
         }
 
+        void set_time_limit(const int milliseconds)
+        {
+            if (!model_ || milliseconds < 0)
+                error();
+            // A limit of zero goes back to the fixed depth search
+            if (milliseconds == 0)
+                model_->set_time_limit(std::nullopt);
+            else
+                model_->set_time_limit(std::chrono::milliseconds(milliseconds));
+            std::cout << std::format("time limit {}ms\n", milliseconds) << std::flush;
+        }
+
+        void set_thread_count(const int threads)
+        {
+            if (!model_ || threads <= 0)
+                error();
+            model_->set_thread_count(static_cast<std::size_t>(threads));
+            std::cout << std::format("threads {}\n", threads) << std::flush;
+        }
+
+        void load_probcut(const std::string_view path)
+        {
+            if (!model_)
+                error();
+            const std::filesystem::path fspath(path);
+            if (!exists(fspath))
+                error();
+            model_->set_probcut(flr::ProbCutParameters::load(fspath));
+            std::cout << std::format("loaded {}\n", path) << std::flush;
+        }
+
         void play(const std::string_view move_str)
         {
             if (state_.legal_moves == 0)
@@ -167,36 +204,19 @@ namespace
                 error();
             const auto& eval = model_->get_evaluator();
             std::vector<std::pair<flr::Coords, float>> evals;
-            const auto do_analyze = [&](const auto& evaluate)
-            {
-                if (state_.legal_moves == 0)
-                {
-                    auto state = state_;
-                    state.play(flr::Coords::none);
-                    evals.emplace_back(flr::Coords::none, -evaluate(state));
-                    return;
-                }
-                for (int i = 0; i < 64; i++)
-                {
-                    if (((1ull << i) & state_.legal_moves) == 0)
-                        continue;
-                    auto state = state_;
-                    const auto move = static_cast<flr::Coords>(i);
-                    state.play(move);
-                    evals.emplace_back(move, -evaluate(state));
-                }
-            };
             if (state_.board.count_empty() > model_->endgame_depth())
             {
+                // Scores of all the moves in one search, sharing the transposition table between them
                 flr::MidgameSearcher searcher;
-                do_analyze([&](const flr::GameState& state)
-                    { return searcher.evaluate(state, eval, model_->midgame_depth() - 1).score; });
+                const auto res = searcher.search_multi_pv(state_, eval, model_->midgame_depth(), flr::cell_count);
+                for (const auto& [move, score, pv] : res.moves)
+                    evals.emplace_back(move, score);
             }
             else
             {
                 flr::EndgameSolver solver;
-                do_analyze(
-                    [&](const flr::GameState& state) { return static_cast<float>(solver.evaluate(state).score); });
+                for (const auto [move, score] : solver.solve_all(state_).moves)
+                    evals.emplace_back(move, static_cast<float>(score));
             }
             std::ranges::sort(evals, std::greater(), &std::pair<flr::Coords, float>::second);
             for (const auto& [move, score] : evals)
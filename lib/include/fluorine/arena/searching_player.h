@@ -1,9 +1,14 @@
 #pragma once
 
+#include <chrono>
+#include <optional>
+#include <variant>
+
 #include "player.h"
 #include "../evaluation/evaluator.h"
 #include "../evaluation/midgame_searcher.h"
 #include "../evaluation/endgame_solver.h"
+#include "../evaluation/static_pattern_evaluator.h"
 
 FLUORINE_SUPPRESS_EXPORT_WARNING
 
@@ -17,13 +22,33 @@ namespace flr
         [[nodiscard]] const Evaluator& get_evaluator() const noexcept { return *eval_; }
         [[nodiscard]] int midgame_depth() const noexcept { return midgame_depth_; }
         [[nodiscard]] int endgame_depth() const noexcept { return endgame_depth_; }
+        [[nodiscard]] auto time_limit() const noexcept { return time_limit_; }
+
+        /// \brief Limit the time spent on each midgame move.
+        /// \details With a time limit the midgame search uses iterative deepening, and the midgame depth acts as
+        /// the maximum depth. Passing std::nullopt restores the fixed depth search.
+        void set_time_limit(const std::optional<std::chrono::milliseconds> limit) noexcept { time_limit_ = limit; }
+
+        /// \brief Enable Multi-ProbCut in the midgame search, see MidgameSearcher::set_probcut.
+        void set_probcut(std::optional<ProbCutParameters> params, float threshold = default_probcut_threshold);
+
+        /// \brief Set the number of threads used by the midgame search, see MidgameSearcher::set_thread_count.
+        void set_thread_count(std::size_t threads);
 
     private:
         std::unique_ptr<const Evaluator> eval_;
         int midgame_depth_;
         int endgame_depth_;
-        MidgameSearcher searcher_;
+        std::optional<std::chrono::milliseconds> time_limit_;
+        // Evaluators of known final types get a searcher specialized for them
+        using Searcher = std::variant<MidgameSearcher, BasicMidgameSearcher<LinearPatternEvaluator>,
+            BasicMidgameSearcher<BasicQuantizedPatternEvaluator<std::int16_t>>,
+            BasicMidgameSearcher<BasicQuantizedPatternEvaluator<std::int8_t>>,
+            BasicMidgameSearcher<QuantizedNeuralEvaluator>, BasicMidgameSearcher<StandardPatternEvaluator>>;
+        Searcher searcher_;
         EndgameSolver solver_;
+
+        static Searcher make_searcher(const Evaluator* evaluator);
     };
 } // namespace flr
 
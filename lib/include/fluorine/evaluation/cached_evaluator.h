@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+#include "evaluator.h"
+
+FLUORINE_SUPPRESS_EXPORT_WARNING
+
+namespace flr
+{
+    struct EvaluationCacheStats
+    {
+        std::uint64_t lookups = 0;
+        std::uint64_t hits = 0;
+
+        [[nodiscard]] double hit_rate() const noexcept
+        {
+            return lookups == 0 ? 0.0 : static_cast<double>(hits) / static_cast<double>(lookups);
+        }
+    };
+
+    /// \brief Decorator of any evaluator that remembers the scores of recently evaluated boards.
+    /// \details The cache is a direct-mapped table indexed by a hash of the board, newer entries simply replace
+    /// older ones. It can be shared by the search threads, the entries are stored without locks like the ones of
+    /// TranspositionTable. Only the floating point scores are cached, so evaluate_fixed is always the rounded
+    /// floating point score, as the search already assumes for evaluate_batch. This pays off for evaluators which
+    /// are a lot slower than a cache miss, the pattern evaluators have their own incremental updates instead.
+    class FLUORINE_API CachedEvaluator final : public Evaluator
+    {
+    public:
+        /// \brief Wrap an evaluator with a cache of table_size entries, which must be a power of two.
+        explicit CachedEvaluator(std::unique_ptr<Evaluator> evaluator, std::size_t table_size = 1 << 20);
+
+        /// \brief The clone wraps a clone of the evaluator, with an empty cache of its own.
+        [[nodiscard]] std::unique_ptr<Evaluator> clone() const override;
+        [[nodiscard]] float evaluate(const Board& board) const override;
+        void evaluate_batch(std::span<const Board> boards, std::span<float> scores) const override;
+
+        [[nodiscard]] const Evaluator& evaluator() const noexcept { return *evaluator_; }
+        [[nodiscard]] std::size_t table_size() const noexcept { return table_size_; }
+
+        [[nodiscard]] EvaluationCacheStats stats() const noexcept;
+        void reset_stats() noexcept;
+
+        /// \brief Forget all the cached scores, which must be done if the weights of the evaluator change.
+        void clear() noexcept;
+
+    private:
+        struct Entry
+        {
+            std::atomic<std::uint64_t> black{};
+            std::atomic<std::uint64_t> white{};
+            std::atomic<std::uint64_t> data{}; // Score bits and a flag telling the entry is not empty
+        };
+
+        std::unique_ptr<Evaluator> evaluator_;
+        std::size_t table_size_;
+        int index_shift_ = 0; // The index is the high bits of the hash, the ones above this bit
+        std::unique_ptr<Entry[]> entries_;
+        mutable std::atomic<std::uint64_t> lookups_{};
+        mutable std::atomic<std::uint64_t> hits_{};
+
+        [[nodiscard]] Entry& entry_of(const Board& board) const noexcept;
+        [[nodiscard]] static bool try_load(const Entry& entry, const Board& board, float& score) noexcept;
+        static void store(Entry& entry, const Board& board, float score) noexcept;
+    };
+} // namespace flr
+
+FLUORINE_RESTORE_EXPORT_WARNING
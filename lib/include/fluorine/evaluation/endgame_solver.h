@@ -1,5 +1,7 @@
 #pragma once
 
+#include <vector>
+
 #include "transposition_table.h"
 #include "../core/game.h"
 
@@ -21,10 +23,28 @@ namespace flr
             std::size_t traversed_nodes = 0;
             int score = -static_cast<int>(cell_count) - 1;
             Coords move = Coords::none;
+            std::vector<Coords> pv; //< Principal variation starting with move, until the end of the game
+        };
+
+        struct MoveScore final
+        {
+            Coords move = Coords::none;
+            int score = 0;
+        };
+
+        struct SolveAllResult final
+        {
+            std::size_t traversed_nodes = 0;
+            std::vector<MoveScore> moves; //< Best move first
         };
 
         [[nodiscard]] EvalResult evaluate(const GameState& state);
         [[nodiscard]] SolveResult solve(const GameState& state);
+
+        /// \brief Get the exact scores of all legal moves in one pass.
+        /// \details The transposition table is shared by the moves, and each move is first searched with the window
+        /// closed above the best score so far, and only re-searched if it turns out to be better.
+        [[nodiscard]] SolveAllResult solve_all(const GameState& state);
         [[nodiscard]] const auto& transposition_table() const noexcept { return tt_; }
         void clear_transposition_table() noexcept { tt_.clear(); }
 
@@ -35,6 +55,7 @@ namespace flr
         int negamax(const GameState& state, int alpha, int beta, int depth, bool passed);
         int negamax_last(const GameState& state, bool passed);
         int negascout(GameState state, int alpha, int beta, int depth, bool passed);
+        std::vector<Coords> principal_variation(GameState state, int score);
     };
 } // namespace flr
 
@@ -3,12 +3,54 @@
 #include <memory>
 #include <iosfwd>
 #include <filesystem>
+#include <cmath>
+#include <algorithm>
+#include <span>
 
 #include "transposition_table.h"
 #include "../core/game.h"
 
 namespace flr
 {
+    /// \brief Midgame search scores are fixed point numbers in units of 1/score_scale disks.
+    inline constexpr int score_scale = 64;
+
+    /// \brief Fixed point scores are strictly between -fixed_inf and fixed_inf.
+    inline constexpr int fixed_inf = static_cast<int>(cell_count) * score_scale + 1;
+
+    /// \brief Storage type of fixed point scores.
+    using FixedScore = std::int16_t;
+
+    template <>
+    struct ScoreTraits<FixedScore>
+    {
+        static constexpr auto inf = static_cast<FixedScore>(fixed_inf);
+    };
+    static_assert(Bounds<FixedScore>::inf == fixed_inf);
+
+    [[nodiscard]] inline int to_fixed_score(const float score) noexcept
+    {
+        constexpr auto max = static_cast<float>(fixed_inf - 1);
+        return static_cast<int>(std::lround(std::clamp(score * static_cast<float>(score_scale), -max, max)));
+    }
+
+    /// \brief Convert a fixed point score back to disks, mapping the infinities to the floating point ones.
+    [[nodiscard]] constexpr float from_fixed_score(const int score) noexcept
+    {
+        if (score >= fixed_inf)
+            return inf;
+        if (score <= -fixed_inf)
+            return -inf;
+        return static_cast<float>(score) / static_cast<float>(score_scale);
+    }
+
+    /// \brief Stage of a board when the game is divided into the given number of stages by the number of disks.
+    /// \details A full board gets the number of stages itself, one past the last stage.
+    [[nodiscard]] constexpr std::size_t stage_of(const Board& board, const std::size_t stages) noexcept
+    {
+        return static_cast<std::size_t>(board.count_total() - 4) * stages / (cell_count - 4);
+    }
+
     class FLUORINE_API Evaluator
     {
     public:
@@ -21,15 +63,69 @@ namespace flr
 
         [[nodiscard]] virtual std::unique_ptr<Evaluator> clone() const = 0;
         [[nodiscard]] virtual float evaluate(const Board& board) const = 0;
+
+        /// \brief Evaluate the board as a fixed point score, as used by the midgame search.
+        [[nodiscard]] virtual int evaluate_fixed(const Board& board) const { return to_fixed_score(evaluate(board)); }
+
+        /// \brief Evaluate several boards at once, the scores must be the same as the ones given by evaluate.
+        /// \details The search uses this for the children of nodes at depth 1. The default
+        /// implementation just calls evaluate in a loop.
+        virtual void evaluate_batch(std::span<const Board> boards, std::span<float> scores) const;
     };
 
     using DataPoint = std::pair<Board, Bounds<float>>;
     using Dataset = std::vector<DataPoint>;
 
+    /// \brief Update rule of the weights in LearnableEvaluator::optimize.
+    enum class Optimizer : std::uint8_t
+    {
+        sgd, ///< Gradient descent with a fixed learning rate
+        adagrad, ///< The learning rate of each weight is divided by the root of the sum of its squared gradients
+        adam ///< Adam with betas of 0.9 and 0.999, the learning rate is the step size
+    };
+
+    /// \brief Settings of how LearnableEvaluator::optimize runs, which train_evaluator takes from TrainOptions.
+    struct TrainingConfig
+    {
+        std::size_t threads = 1;
+        bool parallel_stages = false; //< Train each stage separately, for evaluators with disjoint stage weights
+        Optimizer optimizer = Optimizer::sgd;
+    };
+
+    /// \brief A dataset made ready for an evaluator to train several epochs on, see
+    /// LearnableEvaluator::prepare_dataset.
+    class FLUORINE_API PreparedDataset
+    {
+    public:
+        PreparedDataset() noexcept = default;
+        virtual ~PreparedDataset() noexcept = default;
+        PreparedDataset(const PreparedDataset&) = delete;
+        PreparedDataset(PreparedDataset&&) = delete;
+        PreparedDataset& operator=(const PreparedDataset&) = delete;
+        PreparedDataset& operator=(PreparedDataset&&) = delete;
+
+        /// \brief The mean squared error of the evaluator on the data.
+        [[nodiscard]] virtual float calculate_mse() const = 0;
+
+        /// \brief Train the evaluator for one epoch on the data in an order shuffled by the random generator of the
+        /// thread, and return the mean squared error during the epoch.
+        virtual float optimize_epoch(std::size_t batch_size, float lr) = 0;
+    };
+
     class FLUORINE_API LearnableEvaluator : public Evaluator
     {
     public:
         virtual float optimize(std::span<const DataPoint> dataset, std::size_t batch_size, float lr) = 0;
+
+        /// \brief Change how optimize runs, evaluators ignore the settings they do not support.
+        virtual void configure_training(const TrainingConfig& config) { (void)config; }
+
+        /// \brief Get a dataset ready for training several epochs on it, which is how train_evaluator trains.
+        /// \details The default trains with optimize on the dataset itself, which is shuffled before each epoch.
+        /// Evaluators can instead convert the data once into something faster to train on. Both the evaluator and
+        /// the dataset must outlive the result.
+        [[nodiscard]] virtual std::unique_ptr<PreparedDataset> prepare_dataset(Dataset& dataset);
+
         virtual void save(std::ostream& stream) const = 0;
         void save(const std::filesystem::path& path) const;
     };
@@ -3,62 +3,244 @@
 #include <iosfwd>
 #include <span>
 #include <filesystem>
+#include <array>
+#include <algorithm>
 
 #include "evaluator.h"
+#include "pattern.h"
+#include "scalar_features.h"
+#include "../utils/aligned_allocator.h"
 
 FLUORINE_SUPPRESS_EXPORT_WARNING
 
 namespace flr
 {
+    template <typename WeightT>
+    class BasicQuantizedPatternEvaluator;
+    template <BitBoard... Patterns>
+    class StaticPatternEvaluator;
+
     class FLUORINE_API LinearPatternEvaluator final : public LearnableEvaluator
     {
     public:
-        enum class Symmetry : std::uint8_t
+        using Symmetry = PatternSymmetry;
+
+        /// \brief Ternary indices of every pattern instance of a position.
+        /// \details Playing a move only changes the indices of the patterns covering the placed and flipped disks,
+        /// so the searchers keep one of these and update it on every move instead of extracting all the patterns
+        /// from the board at each leaf.
+        class FeatureState
         {
-            none,
-            diagonal,
-            axial
+        private:
+            friend class LinearPatternEvaluator;
+            template <typename>
+            friend class BasicQuantizedPatternEvaluator;
+            std::vector<std::uint16_t> indices_; // All the instances from the perspective of black, then of white
         };
 
-        explicit LinearPatternEvaluator(std::span<const BitBoard> patterns, std::size_t stages = 1);
+        /// \brief A dataset converted once into the weight indices each of its positions uses, so that training
+        /// several epochs on it does not extract the patterns again.
+        /// \details Each position is a packed row of its stage, the index into the weights of its pattern for each
+        /// pattern instance, and the values of the scalar features. A cache only works with the evaluator it was
+        /// built by, or one with the same patterns, stages and scalar features.
+        class FeatureCache
+        {
+        public:
+            [[nodiscard]] std::size_t size() const noexcept { return bounds_.size(); }
+
+            /// \brief Shuffle the order the positions are trained in, which is the same as shuffling the dataset
+            /// it was built from with the same generator.
+            template <typename URBG>
+            void shuffle(URBG&& rng)
+            {
+                std::ranges::shuffle(order_, std::forward<URBG>(rng));
+            }
+
+        private:
+            friend class LinearPatternEvaluator;
+            std::size_t stages_ = 0;
+            std::vector<BitBoard> patterns_;
+            std::vector<ScalarFeature> scalar_features_;
+            std::size_t row_size_ = 0;
+            std::vector<std::uint16_t> rows_;
+            std::vector<Bounds<float>> bounds_;
+            std::vector<std::uint32_t> order_;
+            float final_se_ = 0.0f; // Positions in the last stage are scored by the disk difference
+
+            [[nodiscard]] const std::uint16_t* row(const std::size_t index) const noexcept
+            {
+                return rows_.data() + index * row_size_;
+            }
+        };
+
+        /// \brief Create an evaluator with all the weights being zero.
+        /// \param patterns The patterns, each with a table of weights for each stage.
+        /// \param stages The number of stages the game is divided into by the number of disks.
+        /// \param scalar_features Global features of the positions, each with a weight for each stage, which let a
+        /// smaller pattern set be just as accurate.
+        explicit LinearPatternEvaluator(std::span<const BitBoard> patterns, std::size_t stages = 1,
+            std::span<const ScalarFeature> scalar_features = {});
 
         [[nodiscard]] std::unique_ptr<Evaluator> clone() const override;
         [[nodiscard]] float evaluate(const Board& board) const override;
+        [[nodiscard]] int evaluate_fixed(const Board& board) const override;
+
+        /// \brief Extract the features of a board from scratch.
+        [[nodiscard]] FeatureState features_of(const Board& board) const;
+
+        /// \brief Update the features after the board changed from one position to another.
+        /// \details The cost is proportional to the number of changed squares, so this is used both for playing a
+        /// move and for undoing it.
+        void update_features(FeatureState& features, const Board& from, const Board& to) const noexcept;
+
+        /// \brief Evaluate a game state whose features are already known, the result is the same as evaluating
+        /// the canonical board of the state.
+        [[nodiscard]] float evaluate(const GameState& state, const FeatureState& features) const noexcept;
+        [[nodiscard]] int evaluate_fixed(const GameState& state, const FeatureState& features) const noexcept;
+
+        /// \brief Train with mini-batch gradient descent.
+        /// \details With several training threads, each batch is split among them, and the gradients they compute
+        /// are reduced in the order of the data, so the weights are the same as when training on one thread. The
+        /// threads then each apply the gradients of their own range of the weights. They synchronize twice per
+        /// batch, so threads only pay off with batches of at least a few hundred data points.
+        /// With TrainingConfig::parallel_stages, the data is partitioned by stage instead, and each stage is
+        /// trained on its own with batches of its data only, as the stages share no weights. The state of the
+        /// adaptive optimizers is only updated for the weights used by a batch, the decay of the moments of Adam
+        /// during the batches a weight was not used is caught up with the next time it is.
         float optimize(std::span<const DataPoint> dataset, std::size_t batch_size, float lr) override;
+        void configure_training(const TrainingConfig& config) override;
+
+        [[nodiscard]] FeatureCache build_feature_cache(std::span<const DataPoint> dataset) const;
+
+        /// \brief Train on the positions of a feature cache in its order, the same way as on the dataset.
+        float optimize(const FeatureCache& cache, std::size_t batch_size, float lr);
+
+        /// \brief The mean squared error on the positions of a feature cache.
+        [[nodiscard]] float calculate_mse(const FeatureCache& cache) const;
+
+        /// \brief Train on a feature cache of the dataset, which is built here once for all the epochs.
+        [[nodiscard]] std::unique_ptr<PreparedDataset> prepare_dataset(Dataset& dataset) override;
 
         void randomize_weights();
+
+        /// \brief Load an evaluator saved in either format.
         [[nodiscard]] static std::unique_ptr<LinearPatternEvaluator> load(std::istream& stream);
+
+        /// \brief Load an evaluator saved in either format, files in the packed format are memory mapped.
+        /// \details The weights of a mapped evaluator are read directly from the mapping, which is shared by all
+        /// the clones of the evaluator, and only copied if the evaluator gets trained.
         [[nodiscard]] static std::unique_ptr<LinearPatternEvaluator> load(const std::filesystem::path& path);
+
         void save(std::ostream& stream) const override;
         using LearnableEvaluator::save;
 
-        void add_pattern(BitBoard pattern) { patterns_.emplace_back(pattern, stages_); }
+        /// \brief Save in the versioned packed format, which has the weights laid out as in memory, aligned to
+        /// cache lines, so that it can be loaded by memory mapping the file.
+        void save_packed(std::ostream& stream) const;
+        void save_packed(const std::filesystem::path& path) const;
+
+        void add_pattern(BitBoard pattern);
+
+        /// \brief Add a scalar feature with zero weights, each feature can only be added once.
+        void add_scalar_feature(ScalarFeature feature);
 
     private:
+        template <typename>
+        friend class BasicQuantizedPatternEvaluator;
+        template <BitBoard...>
+        friend class StaticPatternEvaluator;
+
         struct FLUORINE_API Pattern
         {
             BitBoard pattern;
             Symmetry symmetry;
-            std::vector<std::uint16_t> index_map;
+            PatternExtractor extractor;
+            std::shared_ptr<const std::vector<std::uint16_t>> index_map; // Shared by all the patterns of this shape
             std::size_t count;
-            std::vector<float> weights;
-            std::vector<float> gradients;
-
-            explicit Pattern(BitBoard mask, std::size_t stages);
-            static Pattern load(std::istream& stream, std::size_t stages);
-            void save(std::ostream& stream) const;
-            std::span<float> weights_at_stage(std::size_t stage) noexcept;
-            std::span<const float> weights_at_stage(std::size_t stage) const noexcept;
-            std::span<float> gradients_at_stage(std::size_t stage) noexcept;
-            void apply_gradients() noexcept;
-            void reset_gradients();
+            std::size_t offset = 0; // Offset of the weights of this pattern in a stage of the arena
+
+            explicit Pattern(BitBoard mask);
+        };
+
+        struct GradientUpdate
+        {
+            std::uint32_t offset; // In the arena
+            float gradient;
         };
 
         std::size_t stages_;
         std::vector<Pattern> patterns_;
+        std::vector<ScalarFeature> scalar_features_;
+        // The weights of every pattern in one arena, stage-major, with each stage padded to whole cache lines.
+        // The weights of the scalar features of a stage follow the ones of the patterns.
+        // The arena and the expanded weights are shared between clones, and may point into a mapped file.
+        std::shared_ptr<const float> weights_;
+        bool weights_writable_ = false; // Whether the arena is a vector, which may still be shared
+        CacheAlignedVector<float> gradients_; // Same layout as the weights, all zero outside of optimize
+        std::size_t training_threads_ = 1;
+        bool parallel_stages_ = false;
+        Optimizer optimizer_ = Optimizer::sgd;
+        // Same layout as the weights, the sum of the squared gradients for AdaGrad, or the two moments for Adam
+        CacheAlignedVector<float> optimizer_state_;
+        std::vector<std::uint32_t> last_steps_; // The Adam step each weight was last updated at
+        std::vector<std::uint32_t> steps_; // Number of Adam steps of each stage
+        std::vector<float> step_sizes_; // Learning rate of each stage with the bias correction of its current step
+        std::size_t stage_weight_size_ = 0;
+        std::size_t scalar_weight_offset_ = 0;
+        // Pattern instances are the patterns in each of their orientations, padded for vectorization
+        std::size_t padded_instance_count_ = 0;
+        std::vector<std::uint32_t> instance_offsets_; // Offset of the table of each instance in a stage
+        // Weights of every pattern with the index maps applied, so that the weight of an instance is just at its
+        // offset plus its ternary index. Stage-major, each stage starts with a zero weight for the padding.
+        std::shared_ptr<const float> expanded_weights_;
+        std::size_t stage_table_size_ = 0; // Padded to whole cache lines like the arena
+        std::size_t feature_size_ = 0; // Length of FeatureState::indices_
+        // Changes of the feature indices when a black or a white disk is placed on each square, dense so that the
+        // updates can be vectorized. Every other change of a square is a sum or difference of these two.
+        std::vector<std::uint16_t> black_deltas_;
+        std::vector<std::uint16_t> white_deltas_;
 
         LinearPatternEvaluator() noexcept = default;
         std::size_t stage_of(const Board& board) const noexcept;
+        std::span<const float> weights_at_stage(const Pattern& pattern, std::size_t stage) const noexcept;
+        std::span<const float> scalar_weights_at_stage(std::size_t stage) const noexcept;
+        float* mutable_weights();
+        void assign_weight_offsets();
+        void layout_weights(std::size_t old_scalar_count = 0);
+        void load_packed_layout(std::size_t stages, std::span<const BitBoard> patterns,
+            std::span<const ScalarFeature> scalar_features, std::size_t stage_weight_size,
+            std::size_t stage_table_size);
+        [[nodiscard]] float evaluate_scalars(const Board& board, std::size_t stage) const noexcept;
+        // The data points are given by their count and functions of their index, which give the stage of a point
+        // and append its gradients, see compute_gradients
+        template <typename StageOf, typename ComputeGradients>
+        float optimize_points(std::size_t size, std::size_t batch_size, float lr, StageOf&& stage_of_point,
+            ComputeGradients&& compute);
+        // Descend on the batches of the data in order, returning the sum of the squared errors
+        template <typename ComputeGradients>
+        float optimize_batches(std::size_t size, std::size_t batch_size, float lr, std::size_t threads,
+            float* weights, std::size_t stage_begin, std::size_t stage_end, ComputeGradients&& compute);
+        // Count a batch of data of the stages in [stage_begin, stage_end) for the optimizer, before its gradients
+        // are applied
+        void start_optimizer_step(float lr, std::size_t stage_begin, std::size_t stage_end) noexcept;
+        // Apply the gradients of a batch and zero them, the updates of each offset must all be in the given parts
+        void apply_gradients(std::span<const std::vector<GradientUpdate>> parts, float* weights, float lr) noexcept;
+        template <typename StageOf, typename ComputeGradients>
+        float optimize_stages(std::size_t size, std::size_t batch_size, float lr, float* weights,
+            StageOf&& stage_of_point, ComputeGradients&& compute);
+        // Append the gradients of the weights used by a data point, scaled by mult, and return the error
+        float compute_gradients(const DataPoint& point, float mult, std::vector<GradientUpdate>& updates) const;
+        float compute_gradients(
+            const FeatureCache& cache, std::size_t row, float mult, std::vector<GradientUpdate>& updates) const;
+        // Turn the updates of the instances of a data point, from first_update on, into its gradients
+        float finish_gradients(float predicted, Bounds<float> bounds, float mult, std::size_t stage,
+            const float* scalar_values, std::size_t first_update, std::vector<GradientUpdate>& updates) const;
+        void check_feature_cache(const FeatureCache& cache) const;
+        void reset_optimizer_state() noexcept;
+        [[nodiscard]] float evaluate_transformed(const std::array<BitBoard, 8>& self_d4,
+            const std::array<BitBoard, 8>& opponent_d4, std::size_t stage) const;
+        void build_instance_tables();
+        void expand_weights();
     };
 } // namespace flr
 
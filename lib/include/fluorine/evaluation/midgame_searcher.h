@@ -1,16 +1,35 @@
 #pragma once
 
-#include <clu/static_vector.h>
+#include <chrono>
+#include <optional>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #include "transposition_table.h"
 #include "evaluator.h"
+#include "probcut.h"
 #include "../core/game.h"
 
 FLUORINE_SUPPRESS_EXPORT_WARNING
 
 namespace flr
 {
-    class FLUORINE_API MidgameSearcher final
+    class LinearPatternEvaluator;
+    template <typename WeightT>
+    class BasicQuantizedPatternEvaluator;
+    class QuantizedNeuralEvaluator;
+
+    /// \brief Midgame alpha-beta searcher calling the evaluation functions of EvaluatorT.
+    /// \details If EvaluatorT is a final class, the evaluation calls are resolved statically. The library provides
+    /// instantiations for Evaluator, which works with any evaluator through virtual calls, and for
+    /// LinearPatternEvaluator and its quantized forms, QuantizedNeuralEvaluator and StandardPatternEvaluator, which have
+    /// the evaluation function inlined into the search.
+    template <typename EvaluatorT>
+    class BasicMidgameSearcher final
     {
     public:
         struct EvalResult final
@@ -24,23 +43,97 @@ namespace flr
             std::size_t traversed_nodes = 0;
             float score = -inf;
             Coords move = Coords::none;
+            int depth = 0; //< Depth of the last completed iteration
+            std::vector<Coords> pv; //< Principal variation starting with move, may be cut short by table hits
+        };
+
+        struct RankedMove final
+        {
+            Coords move = Coords::none;
+            float score = -inf;
+            std::vector<Coords> pv;
         };
 
-        [[nodiscard]] EvalResult evaluate(const GameState& state, const Evaluator& evaluator, int depth);
-        [[nodiscard]] SolveResult search(const GameState& state, const Evaluator& evaluator, int depth);
+        struct MultiPVResult final
+        {
+            std::size_t traversed_nodes = 0;
+            std::vector<RankedMove> moves; //< Best move first
+        };
+
+        BasicMidgameSearcher();
+        ~BasicMidgameSearcher() noexcept;
+        BasicMidgameSearcher(const BasicMidgameSearcher&) = delete;
+        BasicMidgameSearcher(BasicMidgameSearcher&&) = delete;
+        BasicMidgameSearcher& operator=(const BasicMidgameSearcher&) = delete;
+        BasicMidgameSearcher& operator=(BasicMidgameSearcher&&) = delete;
+
+        [[nodiscard]] EvalResult evaluate(const GameState& state, const EvaluatorT& evaluator, int depth);
+        [[nodiscard]] SolveResult search(const GameState& state, const EvaluatorT& evaluator, int depth);
+
+        /// \brief Search for the best few moves and their principal variations at once.
+        /// \details The root moves are searched with the lower bound of the window at the pv_count-th best score
+        /// found so far, so the top moves get exact scores while the others are cut off early.
+        /// \param pv_count Number of moves to return, pass cell_count to get every legal move.
+        [[nodiscard]] MultiPVResult search_multi_pv(
+            const GameState& state, const EvaluatorT& evaluator, int depth, std::size_t pv_count);
+
+        /// \brief Search with iterative deepening until the time budget is used up.
+        /// \details The transposition table is kept across iterations, and each iteration after the first one
+        /// starts with an aspiration window around the previous score. A new iteration is not started if it is
+        /// not expected to finish in time, and the search stops early when the best move is stable.
+        /// \param time_budget Maximum time to spend on this search.
+        /// \param max_depth Depth at which to stop deepening even if there is time left.
+        [[nodiscard]] SolveResult search_timed(const GameState& state, const EvaluatorT& evaluator,
+            std::chrono::nanoseconds time_budget, int max_depth = static_cast<int>(cell_count));
+
         [[nodiscard]] const auto& transposition_table() const noexcept { return tt_; }
 
+        /// \brief Enable or disable Multi-ProbCut forward pruning.
+        /// \param params Calibrated parameters, or std::nullopt to go back to full-width search.
+        /// \param threshold Number of standard deviations the predicted score must exceed the window by to cut.
+        /// Smaller values prune more aggressively.
+        void set_probcut(std::optional<ProbCutParameters> params, float threshold = default_probcut_threshold);
+
+        /// \brief Set the number of threads used in each search (Lazy SMP).
+        /// \details Helper threads search the same root with perturbed depths and move orders, sharing the
+        /// transposition table with the main thread. Only the result of the main thread is returned. The helper
+        /// threads are started here and wait for the searches, so the searches do not pay for creating them.
+        void set_thread_count(std::size_t threads);
+        [[nodiscard]] std::size_t thread_count() const noexcept { return workers_.size(); }
+
     private:
-        std::size_t nodes_ = 0;
-        GameRecord record_;
-        GameRecord temp_record_;
-        TranspositionTable<float> tt_;
-        const Evaluator* eval_ = nullptr;
-
-        float negamax(float alpha, float beta, int depth, bool passed);
-        float negascout(float alpha, float beta, int depth, bool passed, bool needs_shallow);
-        clu::static_vector<Coords, cell_count> sort_moves(const GameState& state, float alpha, float beta, int depth);
+        class Worker;
+
+        TranspositionTable<FixedScore> tt_;
+        std::optional<ProbCutParameters> probcut_;
+        float probcut_threshold_ = 0.0f;
+        std::vector<std::unique_ptr<Worker>> workers_; // The first one is the main thread
+        std::atomic<bool> stop_helpers_ = false;
+
+        // Thread i runs workers_[i + 1], the state below is guarded by helper_mutex_
+        std::vector<std::thread> helper_threads_;
+        std::mutex helper_mutex_;
+        std::condition_variable helpers_wake_;
+        std::condition_variable helpers_done_;
+        std::uint64_t search_generation_ = 0; // Incremented to hand a new search to the helpers
+        std::size_t busy_helpers_ = 0;
+        bool shutting_down_ = false;
+        GameState helper_state_;
+        int helper_depth_ = 0;
+
+        template <typename F>
+        auto run_workers(const GameState& state, const EvaluatorT& evaluator, int helper_depth, F&& main_search);
+        void helper_loop(std::size_t index, std::uint64_t generation);
+        void stop_helper_threads() noexcept;
     };
+
+    extern template class FLUORINE_API BasicMidgameSearcher<Evaluator>;
+    extern template class FLUORINE_API BasicMidgameSearcher<LinearPatternEvaluator>;
+    extern template class FLUORINE_API BasicMidgameSearcher<BasicQuantizedPatternEvaluator<std::int16_t>>;
+    extern template class FLUORINE_API BasicMidgameSearcher<BasicQuantizedPatternEvaluator<std::int8_t>>;
+    extern template class FLUORINE_API BasicMidgameSearcher<QuantizedNeuralEvaluator>;
+
+    using MidgameSearcher = BasicMidgameSearcher<Evaluator>;
 } // namespace flr
 
 FLUORINE_RESTORE_EXPORT_WARNING
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+#include <filesystem>
+#include <vector>
+
+#include "evaluator.h"
+#include "../utils/aligned_allocator.h"
+
+FLUORINE_SUPPRESS_EXPORT_WARNING
+
+namespace flr
+{
+    class QuantizedNeuralEvaluator;
+
+    /// \brief Small neural network evaluator in the style of NNUE, trained on the CPU.
+    /// \details The inputs are the disks of the side to move and the ones of the opponent, 128 binary features.
+    /// They feed a hidden layer with a clipped ReLU activation, followed by one linear output for each stage of the
+    /// game. As at most 64 inputs are set, the hidden layer is a sum of rows of the weight matrix, which the
+    /// quantized form keeps up to date on every move. This is the training form with floating point weights,
+    /// QuantizedNeuralEvaluator is the one to search with.
+    class FLUORINE_API NeuralEvaluator final : public LearnableEvaluator
+    {
+    public:
+        static constexpr std::size_t input_size = 2 * cell_count;
+
+        /// \brief Create a network with all the weights being zero.
+        /// \param hidden_size Size of the hidden layer, which must be a positive multiple of 32.
+        /// \param stages The number of stages the game is divided into by the number of disks, each with its own
+        /// output weights.
+        explicit NeuralEvaluator(std::size_t hidden_size = 128, std::size_t stages = 1);
+
+        [[nodiscard]] std::unique_ptr<Evaluator> clone() const override;
+        [[nodiscard]] float evaluate(const Board& board) const override;
+
+        float optimize(std::span<const DataPoint> dataset, std::size_t batch_size, float lr) override;
+
+        void randomize_weights();
+
+        [[nodiscard]] std::size_t hidden_size() const noexcept { return hidden_size_; }
+        [[nodiscard]] std::size_t stages() const noexcept { return stages_; }
+
+        [[nodiscard]] static std::unique_ptr<NeuralEvaluator> load(std::istream& stream);
+        [[nodiscard]] static std::unique_ptr<NeuralEvaluator> load(const std::filesystem::path& path);
+
+        void save(std::ostream& stream) const override;
+        using LearnableEvaluator::save;
+
+    private:
+        friend class QuantizedNeuralEvaluator;
+
+        std::size_t hidden_size_;
+        std::size_t stages_;
+        // All the parameters in one vector, and the gradients in the same layout: the input weights, input-major,
+        // then the hidden biases, the output weights, stage-major, and the output biases
+        CacheAlignedVector<float> params_;
+        CacheAlignedVector<float> gradients_;
+
+        std::size_t stage_of(const Board& board) const noexcept;
+        [[nodiscard]] const float* input_weights(std::size_t input) const noexcept;
+        [[nodiscard]] const float* hidden_biases() const noexcept;
+        [[nodiscard]] const float* output_weights(std::size_t stage) const noexcept;
+        [[nodiscard]] float output_bias(std::size_t stage) const noexcept;
+        // Pre-activations of the hidden layer
+        void accumulate(const Board& board, float* hidden) const noexcept;
+    };
+
+    /// \brief Inference form of NeuralEvaluator, with 16-bit hidden layer weights and 8-bit output weights.
+    /// \details The hidden layer is kept in a FeatureState from the perspective of each color, which is updated
+    /// with the rows of the changed squares on every move, so a leaf only costs the clipped activation and the
+    /// output dot product. Those are vectorized with AVX2 where it is available.
+    class FLUORINE_API QuantizedNeuralEvaluator final : public Evaluator
+    {
+    public:
+        /// \brief Hidden layer pre-activations of a position from the perspective of black, then of white.
+        class FeatureState
+        {
+        private:
+            friend class QuantizedNeuralEvaluator;
+            CacheAlignedVector<std::int16_t> accumulators_;
+        };
+
+        /// \brief Export the weights of a trained network.
+        /// \details Throws if the hidden layer could overflow 16 bits for some position, which only happens for
+        /// networks that diverged.
+        explicit QuantizedNeuralEvaluator(const NeuralEvaluator& evaluator);
+
+        [[nodiscard]] std::unique_ptr<Evaluator> clone() const override;
+        [[nodiscard]] float evaluate(const Board& board) const override;
+        [[nodiscard]] int evaluate_fixed(const Board& board) const override;
+
+        /// \brief Compute the hidden layer of a board from scratch.
+        [[nodiscard]] FeatureState features_of(const Board& board) const;
+
+        /// \brief Update the hidden layer after the board changed, for playing a move as well as undoing it.
+        void update_features(FeatureState& features, const Board& from, const Board& to) const noexcept;
+
+        /// \brief Evaluate a game state whose features are already known, the result is the same as evaluating
+        /// the canonical board of the state.
+        [[nodiscard]] float evaluate(const GameState& state, const FeatureState& features) const noexcept;
+        [[nodiscard]] int evaluate_fixed(const GameState& state, const FeatureState& features) const noexcept;
+
+    private:
+        std::size_t hidden_size_ = 0;
+        std::size_t stages_ = 0;
+        CacheAlignedVector<std::int16_t> input_weights_; // Input-major, in units of 1/127 of an activation
+        CacheAlignedVector<std::int16_t> hidden_biases_;
+        CacheAlignedVector<std::int8_t> output_weights_; // Stage-major, with a power of two scale for each stage
+        std::vector<float> output_scales_; // Score of one unit of the output sum at each stage
+        std::vector<float> output_biases_;
+
+        QuantizedNeuralEvaluator() noexcept = default;
+        std::size_t stage_of(const Board& board) const noexcept;
+        void add_rows(std::int16_t* accumulator, BitBoard added, BitBoard removed, std::size_t offset) const noexcept;
+        [[nodiscard]] float propagate(const std::int16_t* accumulator, std::size_t stage) const noexcept;
+    };
+} // namespace flr
+
+FLUORINE_RESTORE_EXPORT_WARNING
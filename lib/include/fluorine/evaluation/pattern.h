@@ -0,0 +1,270 @@
+#pragma once
+
+#include <array>
+#include <algorithm>
+
+#include "../core/board.h"
+#include "../utils/bit.h"
+
+FLUORINE_SUPPRESS_EXPORT_WARNING
+
+namespace flr
+{
+    enum class PatternSymmetry : std::uint8_t
+    {
+        none,
+        diagonal,
+        axial
+    };
+
+    inline constexpr std::size_t max_pattern_size = 10;
+
+    inline constexpr auto powers_of_3 = []
+    {
+        std::array<std::uint16_t, max_pattern_size + 1> res{1};
+        for (std::size_t i = 1; i < res.size(); i++)
+            res[i] = res[i - 1] * 3;
+        return res;
+    }();
+
+    /// \brief Reinterpret a binary number as a ternary number.
+    inline constexpr auto binary_to_ternary_table = []
+    {
+        std::array<std::uint16_t, (1 << max_pattern_size)> table{};
+        for (std::size_t i = 0; i < table.size(); i++)
+            for (std::size_t j = 0; j < max_pattern_size; j++)
+                table[i] += (i & (1ull << j)) ? powers_of_3[j] : std::uint16_t{};
+        return table;
+    }();
+
+    /// \brief Ternary index of the disks of a board in a pattern, black disks count as 1 and white ones as 2.
+    [[nodiscard]] constexpr std::uint16_t extract_pattern(const Board board, const BitBoard pattern) noexcept
+    {
+        const auto black = bit_compressr(board.black, pattern);
+        const auto white = bit_compressr(board.white, pattern);
+        return static_cast<std::uint16_t>(binary_to_ternary_table[black] + binary_to_ternary_table[white] * 2);
+    }
+
+    namespace detail
+    {
+        // Swap the bits in the mask with the bits shift positions above them
+        template <int shift, typename T>
+        constexpr T delta_swap(const T bits, const BitBoard mask) noexcept
+        {
+            const T diff = (bits ^ (bits >> shift)) & mask;
+            return bits ^ diff ^ (diff << shift);
+        }
+
+        template <typename T>
+        constexpr T flip_main_diagonal(const T bits) noexcept
+        {
+            const T res = delta_swap<7>(bits, 0x00aa00aa00aa00aaull);
+            return delta_swap<28>(delta_swap<14>(res, 0x0000cccc0000ccccull), 0x00000000f0f0f0f0ull);
+        }
+
+        template <typename T>
+        constexpr T flip_horizontal(const T bits) noexcept
+        {
+            const T res = delta_swap<1>(bits, 0x5555555555555555ull);
+            return delta_swap<4>(delta_swap<2>(res, 0x3333333333333333ull), 0x0f0f0f0f0f0f0f0full);
+        }
+
+        template <typename T>
+        constexpr T flip_vertical(const T bits) noexcept
+        {
+            const T res = delta_swap<8>(bits, 0x00ff00ff00ff00ffull);
+            return delta_swap<32>(delta_swap<16>(res, 0x0000ffff0000ffffull), 0x00000000ffffffffull);
+        }
+    } // namespace detail
+
+    /// \brief Get all the 8 possible rotoreflections of a board.
+    /// \details The order is identity, 90 degrees counterclockwise, 180 degrees, 90 degrees clockwise, and then the
+    /// same rotations of the board mirrored along the main diagonal. Everything is composed from the three mirrors
+    /// so that it works for SIMD vectors of bitboards as well.
+    template <typename T>
+    [[nodiscard]] constexpr std::array<T, 8> transform_d4(const T bits) noexcept
+    {
+        using namespace detail;
+        const T diagonal = flip_main_diagonal(bits);
+        const T horizontal = flip_horizontal(bits);
+        const T horizontal_diagonal = flip_horizontal(diagonal);
+        return {
+            bits, flip_vertical(diagonal), flip_vertical(horizontal), horizontal_diagonal, //
+            diagonal, flip_vertical(bits), flip_vertical(horizontal_diagonal), horizontal //
+        };
+    }
+
+    /// \brief The smallest of the rotoreflections of a pattern, which is the form the evaluators store it in.
+    [[nodiscard]] constexpr BitBoard find_pattern_canonical_form(const BitBoard mask) noexcept
+    {
+        return std::ranges::min(transform_d4(mask));
+    }
+
+    [[nodiscard]] constexpr PatternSymmetry find_pattern_symmetry(const BitBoard mask) noexcept
+    {
+        using enum PatternSymmetry;
+        if (mask == mirror_horizontal(mask))
+            return axial;
+        if (mask == mirror_main_diagonal(mask))
+            return diagonal;
+        return none;
+    }
+
+    /// \brief Number of distinct orientations of a pattern in a canonical form, symmetric patterns only need the
+    /// first half of the orientations of transform_d4.
+    [[nodiscard]] constexpr std::size_t instance_count_of(const PatternSymmetry symmetry) noexcept
+    {
+        return symmetry == PatternSymmetry::none ? 8 : 4;
+    }
+
+    /// \brief Whether pext is the fastest way to extract any pattern, which is not the case without BMI2,
+    /// or on the AMD processors before Zen 3 where it is microcoded (define FLUORINE_SLOW_PEXT for those).
+#if defined(FLUORINE_HAS_BMI2) && !defined(FLUORINE_SLOW_PEXT)
+    inline constexpr bool fast_pext = true;
+#else
+    inline constexpr bool fast_pext = false;
+#endif
+
+    namespace detail
+    {
+        // Reinterpret a binary number of max_pattern_size bits with the bits reversed as a ternary number
+        inline constexpr auto reversed_binary_to_ternary_table = []
+        {
+            std::array<std::uint16_t, (1 << max_pattern_size)> table{};
+            for (std::size_t i = 0; i < table.size(); i++)
+                for (std::size_t j = 0; j < max_pattern_size; j++)
+                    table[i] += (i & (1ull << j)) ? powers_of_3[max_pattern_size - 1 - j] : std::uint16_t{};
+            return table;
+        }();
+    } // namespace detail
+
+    /// \brief Extraction of the ternary index of a pattern, with a method chosen for the shape of the pattern.
+    /// \details The result is the same as extract_pattern. When pext is slow, lines of squares are gathered into
+    /// the top bits by a single multiplication, in either order, and other patterns are split into runs of adjacent
+    /// squares, which are each just a shift and a mask.
+    class PatternExtractor
+    {
+    public:
+        enum class Method : std::uint8_t
+        {
+            compress, ///< pext
+            multiply, ///< One magic multiplication
+            runs ///< Shifts and masks of the runs of adjacent squares
+        };
+
+        /// \param mask Squares of the pattern.
+        /// \param use_pext Whether to extract with pext, by default only where it is fast. Otherwise one of the other
+        /// methods is picked.
+        constexpr explicit PatternExtractor(const BitBoard mask, const bool use_pext = fast_pext) noexcept: mask_(mask)
+        {
+            if (use_pext)
+                return;
+            if (find_magic(false) || find_magic(true))
+                method_ = Method::multiply;
+            else
+            {
+                find_runs();
+                method_ = Method::runs;
+            }
+        }
+
+        [[nodiscard]] constexpr BitBoard mask() const noexcept { return mask_; }
+        [[nodiscard]] constexpr Method method() const noexcept { return method_; }
+
+        [[nodiscard]] constexpr std::uint16_t operator()(const Board board) const noexcept
+        {
+            switch (method_)
+            {
+                case Method::multiply:
+                {
+                    const auto& table = *table_;
+                    return static_cast<std::uint16_t>(table[gather(board.black)] + table[gather(board.white)] * 2);
+                }
+                case Method::runs:
+                {
+                    unsigned res = 0;
+                    for (std::size_t i = 0; i < run_count_; i++)
+                    {
+                        const Run run = runs_[i];
+                        const auto black = (board.black >> run.shift) & run.bits;
+                        const auto white = (board.white >> run.shift) & run.bits;
+                        res += (binary_to_ternary_table[black] + binary_to_ternary_table[white] * 2u) * run.power;
+                    }
+                    return static_cast<std::uint16_t>(res);
+                }
+                default: return extract_pattern(board, mask_);
+            }
+        }
+
+    private:
+        struct Run
+        {
+            std::uint8_t shift = 0;
+            std::uint16_t bits = 0; // Mask of the run after shifting it to the lowest bits
+            std::uint16_t power = 0; // Value of the lowest digit of the run in the ternary index
+        };
+
+        BitBoard mask_;
+        Method method_ = Method::compress;
+        std::uint8_t shift_ = 0;
+        std::uint8_t padding_ = 0;
+        std::uint8_t run_count_ = 0;
+        BitBoard magic_ = 0;
+        const std::array<std::uint16_t, (1 << max_pattern_size)>* table_ = &binary_to_ternary_table;
+        std::array<Run, max_pattern_size> runs_{};
+
+        [[nodiscard]] constexpr BitBoard gather(const BitBoard bits) const noexcept
+        {
+            return ((bits & mask_) * magic_) >> shift_ << padding_;
+        }
+
+        // Move the i-th square of the pattern to the bit i of the top bits of the product, or to the bit size-1-i
+        // if reversed, and check that no two squares ever collide or carry into the top bits for all the subsets
+        // of the pattern. The reversed bits are padded to max_pattern_size bits to reuse one reversed table. A
+        // product can only move bits up, so the magic fails if a square is above its target bit.
+        constexpr bool find_magic(const bool reversed) noexcept
+        {
+            if (mask_ == 0)
+                return false;
+            const int size = std::popcount(mask_);
+            shift_ = static_cast<std::uint8_t>(64 - size);
+            padding_ = static_cast<std::uint8_t>(reversed ? static_cast<int>(max_pattern_size) - size : 0);
+            table_ = reversed ? &detail::reversed_binary_to_ternary_table : &binary_to_ternary_table;
+            magic_ = 0;
+            int rank = 0;
+            for (const int square : SetBits{mask_})
+            {
+                const int target = reversed ? size - 1 - rank : rank;
+                const int offset = static_cast<int>(shift_) + target - square;
+                if (offset < 0 || offset >= 64)
+                    return false;
+                magic_ |= BitBoard{1} << offset;
+                rank++;
+            }
+            for (BitBoard subset = 0; subset < (BitBoard{1} << size); subset++)
+                if ((*table_)[gather(bit_expandr(subset, mask_))] != binary_to_ternary_table[subset])
+                    return false;
+            return true;
+        }
+
+        constexpr void find_runs() noexcept
+        {
+            BitBoard rest = mask_;
+            int rank = 0;
+            while (rest != 0)
+            {
+                const int begin = std::countr_zero(rest);
+                const int length = std::countr_one(rest >> begin);
+                runs_[run_count_++] = {
+                    .shift = static_cast<std::uint8_t>(begin),
+                    .bits = static_cast<std::uint16_t>((1u << length) - 1),
+                    .power = powers_of_3[static_cast<std::size_t>(rank)],
+                };
+                rest &= ~(((BitBoard{1} << length) - 1) << begin);
+                rank += length;
+            }
+        }
+    };
+} // namespace flr
+
+FLUORINE_RESTORE_EXPORT_WARNING
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <vector>
+#include <span>
+#include <iosfwd>
+#include <filesystem>
+
+#include "transposition_table.h"
+#include "evaluator.h"
+
+FLUORINE_SUPPRESS_EXPORT_WARNING
+
+namespace flr
+{
+    inline constexpr float default_probcut_threshold = 1.5f;
+    inline constexpr std::size_t default_probcut_checks = 2;
+
+    /// \brief Per-(stage, depth) linear models used by Multi-ProbCut.
+    /// \details A search of depth d is predicted by several shallow searches, the checks, check i being of depth
+    /// shallow_depth(d, i). For each check the deep result is modeled as deep = slope * shallow + intercept, with a
+    /// residual standard deviation of sigma, so every check has cut bounds of its own. The search tries the cheapest
+    /// check first, which only cuts far outside of the window, and the deeper ones when it fails. Entries that have
+    /// not been calibrated have an infinite sigma and never cut.
+    class FLUORINE_API ProbCutParameters final
+    {
+    public:
+        struct Regression final
+        {
+            float slope = 1.0f;
+            float intercept = 0.0f;
+            float sigma = inf;
+        };
+
+        ProbCutParameters(
+            std::size_t stages, int min_depth, int max_depth, std::size_t checks = default_probcut_checks);
+
+        [[nodiscard]] std::size_t stages() const noexcept { return stages_; }
+        [[nodiscard]] int min_depth() const noexcept { return min_depth_; }
+        [[nodiscard]] int max_depth() const noexcept { return max_depth_; }
+        [[nodiscard]] std::size_t checks() const noexcept { return checks_; }
+        [[nodiscard]] std::size_t stage_of(const Board& board) const noexcept;
+        [[nodiscard]] Regression& regression(std::size_t stage, int depth, std::size_t check = 0) noexcept;
+        [[nodiscard]] const Regression& regression(std::size_t stage, int depth, std::size_t check = 0) const noexcept;
+
+        /// \brief Depth of a shallow search used to predict a search of the given depth.
+        /// \details Check 0 is about half of the depth, and each next check is two plies shallower, keeping the
+        /// parity to avoid the odd-even effect. The result is negative for checks that do not exist at this depth.
+        [[nodiscard]] static constexpr int shallow_depth(const int depth, const std::size_t check = 0) noexcept
+        {
+            return depth / 4 * 2 + (depth & 1) - 2 * static_cast<int>(check);
+        }
+
+        [[nodiscard]] static ProbCutParameters load(std::istream& stream);
+        [[nodiscard]] static ProbCutParameters load(const std::filesystem::path& path);
+        void save(std::ostream& stream) const;
+        void save(const std::filesystem::path& path) const;
+
+    private:
+        std::size_t stages_;
+        int min_depth_;
+        int max_depth_;
+        std::size_t checks_;
+        std::vector<Regression> regressions_;
+
+        std::size_t index_of(std::size_t stage, int depth, std::size_t check) const noexcept;
+    };
+
+    struct ProbCutCalibrationOptions
+    {
+        std::size_t stages = 6;
+        int min_depth = 4;
+        int max_depth = 12;
+        std::size_t checks = default_probcut_checks; //< Shallow searches fitted for each depth
+        std::size_t min_samples = 16; //< Entries with fewer samples are left uncalibrated
+        bool show_progress = true;
+    };
+
+    /// \brief Fit Multi-ProbCut parameters by searching the given positions at the deep depths and at the depths of
+    /// all of their checks.
+    [[nodiscard]] FLUORINE_API ProbCutParameters calibrate_probcut(const Evaluator& evaluator,
+        std::span<const GameState> positions, const ProbCutCalibrationOptions& options = {});
+} // namespace flr
+
+FLUORINE_RESTORE_EXPORT_WARNING
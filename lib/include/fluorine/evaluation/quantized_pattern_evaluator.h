@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "linear_pattern_evaluator.h"
+
+FLUORINE_SUPPRESS_EXPORT_WARNING
+
+namespace flr
+{
+    /// \brief Inference form of LinearPatternEvaluator with the weights quantized to WeightT.
+    /// \details The weights of a pattern at a stage share a power of two scale, so the score of a position is
+    /// accumulated in a 32-bit integer, and the weight tables take a half (int16) or a quarter (int8) of the memory
+    /// of the floating point ones. It evaluates the same features as the evaluator it was exported from, including
+    /// the incremental FeatureState, but it cannot be trained.
+    template <typename WeightT>
+    class BasicQuantizedPatternEvaluator final : public Evaluator
+    {
+        static_assert(std::is_same_v<WeightT, std::int16_t> || std::is_same_v<WeightT, std::int8_t>,
+            "Weights can only be quantized to int16 or int8");
+
+    public:
+        using FeatureState = LinearPatternEvaluator::FeatureState;
+
+        /// \brief Export the weights of a trained evaluator.
+        explicit BasicQuantizedPatternEvaluator(const LinearPatternEvaluator& evaluator);
+
+        [[nodiscard]] std::unique_ptr<Evaluator> clone() const override;
+        [[nodiscard]] float evaluate(const Board& board) const override;
+        [[nodiscard]] int evaluate_fixed(const Board& board) const override;
+
+        /// \brief Extract the features of a board from scratch, see LinearPatternEvaluator::features_of.
+        [[nodiscard]] FeatureState features_of(const Board& board) const;
+
+        /// \brief Update the features after the board changed, see LinearPatternEvaluator::update_features.
+        void update_features(FeatureState& features, const Board& from, const Board& to) const noexcept;
+
+        [[nodiscard]] float evaluate(const GameState& state, const FeatureState& features) const noexcept;
+        [[nodiscard]] int evaluate_fixed(const GameState& state, const FeatureState& features) const noexcept;
+
+    private:
+        struct Pattern
+        {
+            BitBoard pattern;
+            LinearPatternEvaluator::Symmetry symmetry;
+            PatternExtractor extractor;
+        };
+
+        std::size_t stages_ = 0;
+        std::vector<Pattern> patterns_;
+        std::size_t padded_instance_count_ = 0;
+        std::vector<std::uint32_t> instance_offsets_;
+        // Laid out like the expanded weights of LinearPatternEvaluator, with some padding at the end
+        // so that the weights can be fetched with 32-bit gathers
+        CacheAlignedVector<WeightT> weights_;
+        std::vector<std::uint32_t> shifts_; // Scale of the weights of each instance at each stage, as a left shift
+        std::vector<ScalarFeature> scalar_features_;
+        std::vector<int> scalar_weights_; // Stage-major, in units of the accumulator
+        std::size_t stage_table_size_ = 0;
+        std::size_t feature_size_ = 0;
+        std::vector<std::uint16_t> black_deltas_;
+        std::vector<std::uint16_t> white_deltas_;
+
+        BasicQuantizedPatternEvaluator() noexcept = default;
+        std::size_t stage_of(const Board& board) const noexcept;
+        // Scores in units of the accumulator
+        [[nodiscard]] int evaluate_raw(const Board& board) const noexcept;
+        [[nodiscard]] int evaluate_raw(const GameState& state, const FeatureState& features) const noexcept;
+        [[nodiscard]] int evaluate_scalars(const Board& board, std::size_t stage) const noexcept;
+    };
+
+    using Int16PatternEvaluator = BasicQuantizedPatternEvaluator<std::int16_t>;
+    using Int8PatternEvaluator = BasicQuantizedPatternEvaluator<std::int8_t>;
+
+    extern template class FLUORINE_API BasicQuantizedPatternEvaluator<std::int16_t>;
+    extern template class FLUORINE_API BasicQuantizedPatternEvaluator<std::int8_t>;
+} // namespace flr
+
+FLUORINE_RESTORE_EXPORT_WARNING
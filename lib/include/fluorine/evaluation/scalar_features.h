@@ -0,0 +1,37 @@
+#pragma once
+
+#include "../core/board.h"
+
+FLUORINE_SUPPRESS_EXPORT_WARNING
+
+namespace flr
+{
+    /// \brief Global features of a position which are cheap to compute, scored as a weight times their value.
+    /// \details The values are from the perspective of black, who is the side to move on canonical boards.
+    enum class ScalarFeature : std::uint8_t
+    {
+        mobility, ///< Number of legal moves
+        opponent_mobility, ///< Number of legal moves of the opponent
+        potential_mobility, ///< Number of empty squares next to a disk of the opponent
+        opponent_potential_mobility, ///< Number of empty squares next to a disk of the side to move
+        parity, ///< Number of quadrants with an odd number of empty squares
+        stability, ///< Number of stable disks
+        opponent_stability ///< Number of stable disks of the opponent
+    };
+
+    inline constexpr std::size_t scalar_feature_count = 7;
+
+    /// \brief The evaluators weight the values of the scalar features times this, which brings them to the range
+    /// of the pattern weights so that both can be trained with the same learning rate.
+    inline constexpr float scalar_feature_scale = 1.0f / 16.0f;
+
+    /// \brief Find a subset of the disks of self that can never be flipped.
+    /// \details A disk is stable when, along each of the four lines through it, the line is full, or it has a
+    /// stable neighbor of its own color or the edge of the board on one side. This misses some stable disks,
+    /// but all the disks it finds are stable.
+    [[nodiscard]] FLUORINE_API BitBoard find_stable_disks(BitBoard self, BitBoard opponent) noexcept;
+
+    [[nodiscard]] FLUORINE_API int scalar_feature_value(ScalarFeature feature, const Board& board) noexcept;
+} // namespace flr
+
+FLUORINE_RESTORE_EXPORT_WARNING
@@ -0,0 +1,266 @@
+#pragma once
+
+#include <stdexcept>
+#include <utility>
+
+#include "linear_pattern_evaluator.h"
+#include "midgame_searcher.h"
+
+FLUORINE_SUPPRESS_EXPORT_WARNING
+
+namespace flr
+{
+    /// \brief Inference form of LinearPatternEvaluator specialized for a pattern set known at compile time.
+    /// \details The canonical forms and the symmetries of the patterns, the offsets of their tables, the extractors
+    /// of their indices and the changes of the indices on each square are all constants, so both the evaluation
+    /// and the feature updates are fully unrolled, without any loop over the patterns or lookups of the instance
+    /// tables. The weights are the expanded weights of a LinearPatternEvaluator with the same patterns in the same
+    /// order, which are shared with it, so anything saved by LinearPatternEvaluator::save or save_packed can be
+    /// loaded. The scores are the same as the ones of the linear evaluator up to the rounding of the floating point
+    /// additions, which are done in another order.
+    /// The library instantiates BasicMidgameSearcher for StandardPatternEvaluator, other pattern sets are searched
+    /// by MidgameSearcher through the virtual interface.
+    template <BitBoard... Patterns>
+    class StaticPatternEvaluator final : public Evaluator
+    {
+        static_assert(sizeof...(Patterns) > 0, "There must be at least one pattern");
+        static_assert(((Patterns != 0) && ...), "Patterns must not be empty");
+        static_assert(((static_cast<std::size_t>(std::popcount(Patterns)) <= max_pattern_size) && ...),
+            "Patterns can have at most max_pattern_size squares");
+
+        static constexpr std::size_t pattern_count = sizeof...(Patterns);
+        static constexpr std::size_t instance_count = (instance_count_of(find_pattern_symmetry(
+                                                           find_pattern_canonical_form(Patterns))) + ...);
+
+    public:
+        /// \brief Ternary indices of every pattern instance of a position, see LinearPatternEvaluator::FeatureState.
+        class FeatureState
+        {
+        private:
+            friend class StaticPatternEvaluator;
+            // All the instances from the perspective of black, then of white
+            std::array<std::uint16_t, 2 * instance_count> indices_{};
+        };
+
+        /// \brief Share the weights of a trained evaluator, which must have the same patterns in the same order.
+        explicit StaticPatternEvaluator(const LinearPatternEvaluator& evaluator):
+            stages_(evaluator.stages_), weights_(evaluator.expanded_weights_),
+            scalar_features_(evaluator.scalar_features_)
+        {
+            const auto& patterns = evaluator.patterns_;
+            if (patterns.size() != pattern_count)
+                throw std::runtime_error("The evaluator has a different number of patterns");
+            for (std::size_t i = 0; i < pattern_count; i++)
+                if (patterns[i].pattern != masks_[i])
+                    throw std::runtime_error("The evaluator has different patterns");
+            if (evaluator.stage_table_size_ != stage_table_size_)
+                throw std::runtime_error("Mismatched layout of the expanded weights");
+            scalar_weights_.reserve(stages_ * scalar_features_.size());
+            for (std::size_t stage = 0; stage < stages_; stage++)
+                for (const float weight : evaluator.scalar_weights_at_stage(stage))
+                    scalar_weights_.push_back(weight);
+        }
+
+        /// \brief Load the weights saved by LinearPatternEvaluator in either format.
+        [[nodiscard]] static std::unique_ptr<StaticPatternEvaluator> load(std::istream& stream)
+        {
+            return std::make_unique<StaticPatternEvaluator>(*LinearPatternEvaluator::load(stream));
+        }
+
+        /// \brief Load the weights saved by LinearPatternEvaluator in either format, see LinearPatternEvaluator::load.
+        [[nodiscard]] static std::unique_ptr<StaticPatternEvaluator> load(const std::filesystem::path& path)
+        {
+            return std::make_unique<StaticPatternEvaluator>(*LinearPatternEvaluator::load(path));
+        }
+
+        [[nodiscard]] std::unique_ptr<Evaluator> clone() const override
+        {
+            // The weights are shared with the clone
+            auto res = std::unique_ptr<StaticPatternEvaluator>(new StaticPatternEvaluator);
+            res->stages_ = stages_;
+            res->weights_ = weights_;
+            res->scalar_features_ = scalar_features_;
+            res->scalar_weights_ = scalar_weights_;
+            return res;
+        }
+
+        [[nodiscard]] float evaluate(const Board& board) const override
+        {
+            const std::size_t stage = flr::stage_of(board, stages_);
+            if (stage == stages_) [[unlikely]]
+                return static_cast<float>(board.disk_difference());
+            const auto self_d4 = transform_d4(board.black);
+            const auto opponent_d4 = transform_d4(board.white);
+            std::array<std::uint16_t, instance_count> indices; // NOLINT(cppcoreguidelines-pro-type-member-init)
+            [&]<std::size_t... I>(std::index_sequence<I...>)
+            {
+                ((indices[I] = extractors_[instances_[I].pattern]({self_d4[instances_[I].symmetry],
+                      opponent_d4[instances_[I].symmetry]})),
+                    ...);
+            }(std::make_index_sequence<instance_count>{});
+            return sum_weights(stage, indices.data()) + evaluate_scalars(board, stage);
+        }
+
+        [[nodiscard]] int evaluate_fixed(const Board& board) const override { return to_fixed_score(evaluate(board)); }
+
+        /// \brief Extract the features of a board from scratch.
+        [[nodiscard]] FeatureState features_of(const Board& board) const noexcept
+        {
+            FeatureState res;
+            update_features(res, Board::empty, board);
+            return res;
+        }
+
+        /// \brief Update the features after the board changed from one position to another.
+        void update_features(FeatureState& features, const Board& from, const Board& to) const noexcept
+        {
+            // Flipping a disk is removing it and placing one of the other color
+            const auto apply = [&](const BitBoard squares, const auto& deltas, const int sign)
+            {
+                for (const int square : SetBits{squares})
+                {
+                    const auto& delta = deltas[static_cast<std::size_t>(square)];
+                    for (std::size_t i = 0; i < feature_size; i++)
+                        features.indices_[i] = static_cast<std::uint16_t>(features.indices_[i] + sign * delta[i]);
+                }
+            };
+            apply(to.black & ~from.black, deltas_[0], 1);
+            apply(to.white & ~from.white, deltas_[1], 1);
+            apply(from.black & ~to.black, deltas_[0], -1);
+            apply(from.white & ~to.white, deltas_[1], -1);
+        }
+
+        /// \brief Evaluate a game state whose features are already known, the result is the same as evaluating
+        /// the canonical board of the state.
+        [[nodiscard]] float evaluate(const GameState& state, const FeatureState& features) const noexcept
+        {
+            const std::size_t stage = flr::stage_of(state.board, stages_);
+            if (stage == stages_) [[unlikely]]
+                return static_cast<float>(state.disk_difference());
+            const std::uint16_t* indices =
+                features.indices_.data() + (state.current == Color::black ? 0 : instance_count);
+            return sum_weights(stage, indices) + evaluate_scalars(state.canonical_board(), stage);
+        }
+
+        [[nodiscard]] int evaluate_fixed(const GameState& state, const FeatureState& features) const noexcept
+        {
+            return to_fixed_score(evaluate(state, features));
+        }
+
+    private:
+        struct Instance
+        {
+            std::size_t pattern;
+            std::size_t symmetry; // Index of the rotoreflection in transform_d4
+            std::uint32_t offset; // Offset of the table of the pattern in a stage
+        };
+
+        static constexpr std::size_t feature_size = 2 * instance_count;
+        // Independent partial sums of the weights, so that the additions do not all wait for each other
+        static constexpr std::size_t accumulator_count = 8;
+
+        static constexpr std::array<BitBoard, pattern_count> masks_{find_pattern_canonical_form(Patterns)...};
+        static constexpr std::array<PatternExtractor, pattern_count> extractors_{
+            PatternExtractor(find_pattern_canonical_form(Patterns))...};
+        // Same layout as the expanded weights of LinearPatternEvaluator, with a zero weight at the start of each
+        // stage and then the table of each pattern
+        static constexpr auto instances_ = []
+        {
+            std::array<Instance, instance_count> res{};
+            std::size_t instance = 0;
+            std::uint32_t offset = 1;
+            for (std::size_t i = 0; i < pattern_count; i++)
+            {
+                for (std::size_t j = 0; j < instance_count_of(find_pattern_symmetry(masks_[i])); j++)
+                    res[instance++] = {i, j, offset};
+                offset += powers_of_3[static_cast<std::size_t>(std::popcount(masks_[i]))];
+            }
+            return res;
+        }();
+        static constexpr std::size_t stage_table_size_ = round_up_to_cache_lines<float>(
+            instances_.back().offset + powers_of_3[static_cast<std::size_t>(std::popcount(masks_.back()))]);
+        // Changes of the features when a black (deltas_[0]) or a white (deltas_[1]) disk is placed on each square
+        static constexpr auto deltas_ = []
+        {
+            std::array<std::array<std::array<std::uint16_t, feature_size>, cell_count>, 2> res{};
+            for (std::size_t square = 0; square < cell_count; square++)
+            {
+                const auto transformed = transform_d4(bit_of(static_cast<Coords>(square)));
+                for (std::size_t i = 0; i < instance_count; i++)
+                {
+                    const BitBoard mask = masks_[instances_[i].pattern];
+                    const BitBoard bit = transformed[instances_[i].symmetry];
+                    if ((bit & mask) == 0)
+                        continue;
+                    // The player's own disk counts as 1 and the opponent's as 2
+                    const auto rank = static_cast<std::size_t>(std::popcount(mask & (bit - 1)));
+                    const std::uint16_t power = powers_of_3[rank];
+                    res[0][square][i] = power;
+                    res[0][square][instance_count + i] = static_cast<std::uint16_t>(power * 2);
+                    res[1][square][i] = static_cast<std::uint16_t>(power * 2);
+                    res[1][square][instance_count + i] = power;
+                }
+            }
+            return res;
+        }();
+
+        std::size_t stages_ = 1;
+        std::shared_ptr<const float> weights_;
+        std::vector<ScalarFeature> scalar_features_;
+        std::vector<float> scalar_weights_; // Stage-major
+
+        StaticPatternEvaluator() noexcept = default;
+
+        float sum_weights(const std::size_t stage, const std::uint16_t* indices) const noexcept
+        {
+            const float* table = weights_.get() + stage * stage_table_size_;
+            std::array<float, accumulator_count> sums{};
+            [&]<std::size_t... I>(std::index_sequence<I...>)
+            {
+                ((sums[I % accumulator_count] += table[instances_[I].offset + indices[I]]), ...);
+            }(std::make_index_sequence<instance_count>{});
+            float res = 0.0f;
+            for (const float sum : sums)
+                res += sum;
+            return res;
+        }
+
+        float evaluate_scalars(const Board& board, const std::size_t stage) const noexcept
+        {
+            const float* weights = scalar_weights_.data() + stage * scalar_features_.size();
+            float res = 0.0f;
+            for (std::size_t i = 0; i < scalar_features_.size(); i++)
+                res += weights[i] * static_cast<float>(scalar_feature_value(scalar_features_[i], board));
+            return res * scalar_feature_scale;
+        }
+    };
+
+    /// \brief The patterns of StandardPatternEvaluator: the edge with the X-squares, the 3x3 and 2x5 corners, the
+    /// second to fourth lines and the diagonals of 4 to 8 squares.
+    inline constexpr std::array<BitBoard, 11> standard_patterns{
+        0x0000'0000'0000'42ffull, // Edge and X-squares
+        0x0000'0000'0007'0707ull, // 3x3 corner
+        0x0000'0000'0000'1f1full, // 2x5 corner
+        0x0000'0000'0000'ff00ull, // Second line
+        0x0000'0000'00ff'0000ull, // Third line
+        0x0000'0000'ff00'0000ull, // Fourth line
+        0x0000'0000'0102'0408ull, // Diagonal of 4 squares
+        0x0000'0001'0204'0810ull, // Diagonal of 5 squares
+        0x0000'0102'0408'1020ull, // Diagonal of 6 squares
+        0x0001'0204'0810'2040ull, // Diagonal of 7 squares
+        0x0102'0408'1020'4080ull, // Main diagonal
+    };
+
+    /// \brief Evaluator of the standard pattern set, for which the library provides a specialized searcher.
+    /// \details Train a LinearPatternEvaluator with standard_patterns and construct this from it for the search.
+    using StandardPatternEvaluator = StaticPatternEvaluator<standard_patterns[0], standard_patterns[1],
+        standard_patterns[2], standard_patterns[3], standard_patterns[4], standard_patterns[5], standard_patterns[6],
+        standard_patterns[7], standard_patterns[8], standard_patterns[9], standard_patterns[10]>;
+
+    extern template class FLUORINE_API StaticPatternEvaluator<standard_patterns[0], standard_patterns[1],
+        standard_patterns[2], standard_patterns[3], standard_patterns[4], standard_patterns[5], standard_patterns[6],
+        standard_patterns[7], standard_patterns[8], standard_patterns[9], standard_patterns[10]>;
+    extern template class FLUORINE_API BasicMidgameSearcher<StandardPatternEvaluator>;
+} // namespace flr
+
+FLUORINE_RESTORE_EXPORT_WARNING
@@ -31,6 +31,9 @@ namespace flr
         std::size_t epochs = 20;
         std::size_t batch_size = 32;
         float learning_rate = 0.01f;
+        std::size_t threads = 1; //< Threads each batch is split among, the result does not depend on it
+        bool parallel_stages = false; //< Train the stages separately on the threads instead of splitting batches
+        Optimizer optimizer = Optimizer::sgd; //< The adaptive ones need fewer epochs, with rates around 0.1 to 0.3
         std::optional<std::uint64_t> seed = std::nullopt;
         bool show_progress = true;
     };
@@ -1,10 +1,16 @@
 #pragma once
 
 #include <vector>
+#include <memory>
+#include <atomic>
+#include <optional>
+#include <span>
+#include <stdexcept>
 #include <limits>
 #include <algorithm>
 #include <ranges>
 #include <bit>
+#include <array>
 #include <clu/concepts.h>
 #include <clu/hash.h>
 
@@ -14,16 +20,24 @@ namespace flr
 {
     inline constexpr float inf = std::numeric_limits<float>::infinity();
 
+    /// \brief The infinity of the scores of type T, which is one past the largest disk difference for integers.
+    /// \details Score types with other units specialize this, it must be specialized before Bounds<T> is used.
     template <clu::arithmetic T>
-    struct Bounds final
+    struct ScoreTraits
     {
         static constexpr T inf = []
         {
             if constexpr (std::is_floating_point_v<T>)
                 return std::numeric_limits<T>::infinity();
             else
-                return static_cast<T>(cell_count) + 1;
+                return static_cast<T>(cell_count + 1);
         }();
+    };
+
+    template <clu::arithmetic T>
+    struct Bounds final
+    {
+        static constexpr T inf = ScoreTraits<T>::inf;
 
         T lower;
         T upper;
@@ -40,11 +54,16 @@ namespace flr
         }
     };
 
+    /// \brief A hash table of search results that can be shared among search threads.
+    /// \details Entries are stored without locks as words XOR-ed with each other, so that an entry torn by
+    /// concurrent writes fails the key check on loading instead of returning mismatched bounds. Bounds of at most
+    /// 32 bits are packed together with the depth, making each entry one word smaller.
     template <clu::arithmetic T>
     class TranspositionTable final
     {
     public:
-        explicit TranspositionTable(const std::size_t table_size = 1 << 22): table_size_(table_size), data_(table_size)
+        explicit TranspositionTable(const std::size_t table_size = 1 << 22):
+            table_size_(table_size), data_(std::make_unique<Entry[]>(table_size))
         {
             if (!std::has_single_bit(table_size_))
                 throw std::runtime_error("Table size must be a power of two");
@@ -64,53 +83,119 @@ namespace flr
 
         void store(const Board& board, const int depth, const Bounds<T> bounds, const std::size_t hash_hint) noexcept
         {
-            data_[hash_hint] = {.state = {board, depth}, .bounds = bounds};
+            const auto packed = pack(depth, bounds);
+            const auto check = checksum(packed);
+            auto& entry = data_[hash_hint];
+            entry.black.store(board.black ^ check, std::memory_order_relaxed);
+            entry.white.store(board.white ^ check, std::memory_order_relaxed);
+            for (std::size_t i = 0; i < data_words; i++)
+                entry.data[i].store(packed[i], std::memory_order_relaxed);
         }
 
-        [[nodiscard]] const Bounds<T>* try_load(const Board& board, const int min_depth) const noexcept
+        [[nodiscard]] std::optional<Bounds<T>> try_load(const Board& board, const int min_depth) const noexcept
         {
             return try_load(board, min_depth, hash(board));
         }
 
-        [[nodiscard]] const Bounds<T>* try_load(
+        [[nodiscard]] std::optional<Bounds<T>> try_load(
             const Board& board, const int min_depth, const std::size_t hash_hint) const noexcept
         {
-            const auto& pair = data_[hash_hint];
-            if (pair.state.board != board || pair.state.depth < min_depth)
-                return nullptr;
-            return &pair.bounds;
+            const auto [stored_board, depth, bounds] = data_[hash_hint].load();
+            if (stored_board != board || depth < min_depth)
+                return std::nullopt;
+            return bounds;
         }
 
-        void clear() noexcept { std::ranges::fill(data_, Entry{}); }
+        void clear() noexcept
+        {
+            for (std::size_t i = 0; i < table_size_; i++)
+                data_[i].clear();
+        }
 
         [[nodiscard]] std::size_t size() const noexcept
         {
-            static constexpr Board empty_board{.black = 0, .white = 0};
-            return static_cast<std::size_t>(std::ranges::count_if(
-                data_, [](const State& state) { return state.board != empty_board; }, &Entry::state));
+            return static_cast<std::size_t>(std::ranges::distance(entries()));
         }
 
         [[nodiscard]] auto entries() const noexcept
         {
-            return data_ //
-                | std::views::filter([](const Entry& entry) { return entry.state.board != Board::empty; }) //
-                | std::views::transform([](const Entry& entry) { return std::pair(entry.state.board, entry.bounds); });
+            return std::span<const Entry>(data_.get(), table_size_) //
+                | std::views::transform([](const Entry& entry) { return entry.load(); }) //
+                | std::views::filter([](const State& state) { return state.board != Board::empty; }) //
+                | std::views::transform([](const State& state) { return std::pair(state.board, state.bounds); });
         }
 
     private:
+        static_assert(sizeof(Bounds<T>) == sizeof(std::uint32_t) || sizeof(Bounds<T>) == sizeof(std::uint64_t));
+
+        static constexpr bool compact = sizeof(Bounds<T>) == sizeof(std::uint32_t);
+        static constexpr std::size_t data_words = compact ? 1 : 2;
+        using Packed = std::array<std::uint64_t, data_words>;
+
         struct State final
         {
-            Board board = Board::empty; // Intended zero init
+            Board board = Board::empty;
             int depth = 0;
+            Bounds<T> bounds;
         };
 
+        static Packed pack(const int depth, const Bounds<T> bounds) noexcept
+        {
+            const auto packed_depth = static_cast<std::uint64_t>(static_cast<std::uint32_t>(depth));
+            if constexpr (compact)
+                return {std::bit_cast<std::uint32_t>(bounds) | packed_depth << 32};
+            else
+                return {packed_depth, std::bit_cast<std::uint64_t>(bounds)};
+        }
+
+        static std::pair<int, Bounds<T>> unpack(const Packed& packed) noexcept
+        {
+            if constexpr (compact)
+                return {static_cast<int>(packed[0] >> 32),
+                    std::bit_cast<Bounds<T>>(static_cast<std::uint32_t>(packed[0]))};
+            else
+                return {static_cast<int>(packed[0]), std::bit_cast<Bounds<T>>(packed[1])};
+        }
+
+        static std::uint64_t checksum(const Packed& packed) noexcept
+        {
+            std::uint64_t res = 0;
+            for (const auto word : packed)
+                res ^= word;
+            return res;
+        }
+
         struct Entry final
         {
-            State state;
-            Bounds<T> bounds;
+            std::atomic<std::uint64_t> black{};
+            std::atomic<std::uint64_t> white{};
+            std::array<std::atomic<std::uint64_t>, data_words> data{};
+
+            [[nodiscard]] State load() const noexcept
+            {
+                Packed packed;
+                for (std::size_t i = 0; i < data_words; i++)
+                    packed[i] = data[i].load(std::memory_order_relaxed);
+                const auto check = checksum(packed);
+                const auto [depth, bounds] = unpack(packed);
+                return {
+                    .board = {black.load(std::memory_order_relaxed) ^ check, //
+                        white.load(std::memory_order_relaxed) ^ check},
+                    .depth = depth,
+                    .bounds = bounds,
+                };
+            }
+
+            void clear() noexcept
+            {
+                black.store(0, std::memory_order_relaxed);
+                white.store(0, std::memory_order_relaxed);
+                for (auto& word : data)
+                    word.store(0, std::memory_order_relaxed);
+            }
         };
 
         std::size_t table_size_;
-        std::vector<Entry> data_;
+        std::unique_ptr<Entry[]> data_;
     };
 } // namespace flr
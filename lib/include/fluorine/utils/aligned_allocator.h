@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+namespace flr
+{
+    inline constexpr std::size_t cache_line_size = 64;
+
+    /// \brief Allocator of storage starting at a boundary of Alignment bytes.
+    template <typename T, std::size_t Alignment>
+    struct AlignedAllocator
+    {
+        static_assert(Alignment >= alignof(T) && (Alignment & (Alignment - 1)) == 0);
+
+        using value_type = T;
+
+        template <typename U>
+        struct rebind
+        {
+            using other = AlignedAllocator<U, Alignment>;
+        };
+
+        AlignedAllocator() noexcept = default;
+        template <typename U>
+        explicit(false) AlignedAllocator(const AlignedAllocator<U, Alignment>&) noexcept
+        {
+        }
+
+        [[nodiscard]] T* allocate(const std::size_t size)
+        {
+            return static_cast<T*>(::operator new(size * sizeof(T), std::align_val_t{Alignment}));
+        }
+
+        void deallocate(T* ptr, const std::size_t size) noexcept
+        {
+            ::operator delete(ptr, size * sizeof(T), std::align_val_t{Alignment});
+        }
+
+        template <typename U>
+        friend bool operator==(const AlignedAllocator&, const AlignedAllocator<U, Alignment>&) noexcept
+        {
+            return true;
+        }
+    };
+
+    /// \brief A vector whose data starts at a cache line boundary.
+    template <typename T>
+    using CacheAlignedVector = std::vector<T, AlignedAllocator<T, cache_line_size>>;
+
+    /// \brief Round a number of elements up so that an array of them fills whole cache lines.
+    template <typename T>
+    constexpr std::size_t round_up_to_cache_lines(const std::size_t size) noexcept
+    {
+        constexpr std::size_t per_line = cache_line_size / sizeof(T);
+        return (size + per_line - 1) / per_line * per_line;
+    }
+} // namespace flr
@@ -2,7 +2,7 @@
 
 #include <bit>
 
-#include "fluorine/core/macros.h"
+#include "../core/macros.h"
 
 #ifdef FLUORINE_HAS_BMI2
     #include <immintrin.h>
@@ -2,7 +2,7 @@
 
 #include <clu/random.h>
 
-#include "../utils/bit.h"
+#include "fluorine/utils/bit.h"
 
 namespace flr
 {
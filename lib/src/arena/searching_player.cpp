@@ -1,21 +1,59 @@
 #include "fluorine/arena/searching_player.h"
 
+#include "fluorine/evaluation/linear_pattern_evaluator.h"
+#include "fluorine/evaluation/quantized_pattern_evaluator.h"
+#include "fluorine/evaluation/neural_evaluator.h"
+
 namespace flr
 {
     SearchingPlayer::SearchingPlayer(
         std::unique_ptr<const Evaluator> evaluator, const int mid_depth, const int end_depth):
         eval_(std::move(evaluator)),
-        midgame_depth_(mid_depth), endgame_depth_(end_depth)
+        midgame_depth_(mid_depth), endgame_depth_(end_depth),
+        searcher_(make_searcher(eval_.get()))
     {
         assert(eval_ != nullptr);
     }
 
+    SearchingPlayer::Searcher SearchingPlayer::make_searcher(const Evaluator* evaluator)
+    {
+        if (dynamic_cast<const LinearPatternEvaluator*>(evaluator))
+            return Searcher(std::in_place_type<BasicMidgameSearcher<LinearPatternEvaluator>>);
+        if (dynamic_cast<const Int16PatternEvaluator*>(evaluator))
+            return Searcher(std::in_place_type<BasicMidgameSearcher<Int16PatternEvaluator>>);
+        if (dynamic_cast<const Int8PatternEvaluator*>(evaluator))
+            return Searcher(std::in_place_type<BasicMidgameSearcher<Int8PatternEvaluator>>);
+        if (dynamic_cast<const QuantizedNeuralEvaluator*>(evaluator))
+            return Searcher(std::in_place_type<BasicMidgameSearcher<QuantizedNeuralEvaluator>>);
+        if (dynamic_cast<const StandardPatternEvaluator*>(evaluator))
+            return Searcher(std::in_place_type<BasicMidgameSearcher<StandardPatternEvaluator>>);
+        return Searcher(std::in_place_type<MidgameSearcher>);
+    }
+
     Coords SearchingPlayer::get_move(const GameState& game)
     {
         if (game.legal_moves == 0)
             return Coords::none;
         if (game.board.count_empty() <= endgame_depth_)
             return solver_.solve(game).move;
-        return searcher_.search(game, *eval_, midgame_depth_).move;
+        return std::visit(
+            [&]<typename E>(BasicMidgameSearcher<E>& searcher)
+            {
+                const auto& eval = static_cast<const E&>(*eval_);
+                if (time_limit_)
+                    return searcher.search_timed(game, eval, *time_limit_, midgame_depth_).move;
+                return searcher.search(game, eval, midgame_depth_).move;
+            },
+            searcher_);
+    }
+
+    void SearchingPlayer::set_probcut(std::optional<ProbCutParameters> params, const float threshold)
+    {
+        std::visit([&](auto& searcher) { searcher.set_probcut(std::move(params), threshold); }, searcher_);
+    }
+
+    void SearchingPlayer::set_thread_count(const std::size_t threads)
+    {
+        std::visit([&](auto& searcher) { searcher.set_thread_count(threads); }, searcher_);
     }
 } // namespace flr
@@ -9,7 +9,7 @@
 #include <immintrin.h>
 #endif
 
-#include "../utils/bit.h"
+#include "fluorine/utils/bit.h"
 
 namespace flr
 {
@@ -3,7 +3,7 @@
 #include <array>
 #include <clu/static_for.h>
 
-#include "../utils/bit.h"
+#include "fluorine/utils/bit.h"
 
 namespace flr
 {
@@ -3,7 +3,7 @@
 #include <stdexcept>
 
 #include "flip.h"
-#include "../utils/bit.h"
+#include "fluorine/utils/bit.h"
 
 namespace flr
 {
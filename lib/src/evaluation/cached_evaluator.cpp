@@ -0,0 +1,139 @@
+#include "fluorine/evaluation/cached_evaluator.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cassert>
+#include <stdexcept>
+
+namespace flr
+{
+    namespace
+    {
+        constexpr std::uint64_t occupied_flag = std::uint64_t{1} << 32;
+
+        // Cheaper than the FNV-1a hash of TranspositionTable, which matters here as a hit must be a lot faster
+        // than the evaluation. A square only changes the bits of the products from its own bit up, so the high
+        // bits are folded down and multiplied again, which spreads every square over the high bits of the result.
+        // The index is taken from those high bits.
+        std::uint64_t hash_board(const Board& board) noexcept
+        {
+            const std::uint64_t h = board.black * 0x9e3779b9'7f4a7c15ull ^ board.white * 0xc2b2ae3d'27d4eb4full;
+            return (h ^ (h >> 32)) * 0xd6e8feb8'6659fd93ull;
+        }
+    } // namespace
+
+    CachedEvaluator::CachedEvaluator(std::unique_ptr<Evaluator> evaluator, const std::size_t table_size):
+        evaluator_(std::move(evaluator)), table_size_(table_size)
+    {
+        if (!evaluator_)
+            throw std::runtime_error("The cached evaluator must not be null");
+        if (!std::has_single_bit(table_size_))
+            throw std::runtime_error("Table size must be a power of two");
+        index_shift_ = 63 - std::countr_zero(table_size_);
+        entries_ = std::make_unique<Entry[]>(table_size_);
+    }
+
+    std::unique_ptr<Evaluator> CachedEvaluator::clone() const
+    {
+        return std::make_unique<CachedEvaluator>(evaluator_->clone(), table_size_);
+    }
+
+    float CachedEvaluator::evaluate(const Board& board) const
+    {
+        lookups_.fetch_add(1, std::memory_order_relaxed);
+        Entry& entry = entry_of(board);
+        float score;
+        if (try_load(entry, board, score))
+        {
+            hits_.fetch_add(1, std::memory_order_relaxed);
+            return score;
+        }
+        score = evaluator_->evaluate(board);
+        store(entry, board, score);
+        return score;
+    }
+
+    void CachedEvaluator::evaluate_batch(const std::span<const Board> boards, const std::span<float> scores) const
+    {
+        assert(boards.size() == scores.size());
+        // The misses are gathered so that the evaluator still gets to evaluate them as a batch
+        constexpr std::size_t chunk_size = 16;
+        for (std::size_t begin = 0; begin < boards.size(); begin += chunk_size)
+        {
+            const std::size_t end = std::min(begin + chunk_size, boards.size());
+            std::array<Board, chunk_size> missed_boards; // NOLINT(cppcoreguidelines-pro-type-member-init)
+            std::array<float, chunk_size> missed_scores; // NOLINT(cppcoreguidelines-pro-type-member-init)
+            std::array<std::size_t, chunk_size> missed_indices; // NOLINT(cppcoreguidelines-pro-type-member-init)
+            std::size_t missed = 0;
+            for (std::size_t i = begin; i < end; i++)
+            {
+                if (try_load(entry_of(boards[i]), boards[i], scores[i]))
+                    continue;
+                missed_boards[missed] = boards[i];
+                missed_indices[missed] = i;
+                missed++;
+            }
+            lookups_.fetch_add(end - begin, std::memory_order_relaxed);
+            hits_.fetch_add(end - begin - missed, std::memory_order_relaxed);
+            if (missed == 0)
+                continue;
+            evaluator_->evaluate_batch({missed_boards.data(), missed}, {missed_scores.data(), missed});
+            for (std::size_t i = 0; i < missed; i++)
+            {
+                scores[missed_indices[i]] = missed_scores[i];
+                store(entry_of(missed_boards[i]), missed_boards[i], missed_scores[i]);
+            }
+        }
+    }
+
+    EvaluationCacheStats CachedEvaluator::stats() const noexcept
+    {
+        return {
+            .lookups = lookups_.load(std::memory_order_relaxed),
+            .hits = hits_.load(std::memory_order_relaxed),
+        };
+    }
+
+    void CachedEvaluator::reset_stats() noexcept
+    {
+        lookups_.store(0, std::memory_order_relaxed);
+        hits_.store(0, std::memory_order_relaxed);
+    }
+
+    void CachedEvaluator::clear() noexcept
+    {
+        for (std::size_t i = 0; i < table_size_; i++)
+        {
+            Entry& entry = entries_[i];
+            entry.black.store(0, std::memory_order_relaxed);
+            entry.white.store(0, std::memory_order_relaxed);
+            entry.data.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    CachedEvaluator::Entry& CachedEvaluator::entry_of(const Board& board) const noexcept
+    {
+        // Shifted in two steps so that a table of a single entry is not shifted by 64 bits
+        return entries_[hash_board(board) >> index_shift_ >> 1];
+    }
+
+    // The board is stored XOR-ed with the data, so that an entry torn by concurrent writes fails the key check
+    bool CachedEvaluator::try_load(const Entry& entry, const Board& board, float& score) noexcept
+    {
+        const std::uint64_t data = entry.data.load(std::memory_order_relaxed);
+        if (!(data & occupied_flag) || (entry.black.load(std::memory_order_relaxed) ^ data) != board.black ||
+            (entry.white.load(std::memory_order_relaxed) ^ data) != board.white)
+            return false;
+        score = std::bit_cast<float>(static_cast<std::uint32_t>(data));
+        return true;
+    }
+
+    void CachedEvaluator::store(Entry& entry, const Board& board, const float score) noexcept
+    {
+        const std::uint64_t data = std::bit_cast<std::uint32_t>(score) | occupied_flag;
+        entry.black.store(board.black ^ data, std::memory_order_relaxed);
+        entry.white.store(board.white ^ data, std::memory_order_relaxed);
+        entry.data.store(data, std::memory_order_relaxed);
+    }
+} // namespace flr
@@ -4,7 +4,7 @@
 
 #include "iterate_moves.h"
 #include "../core/flip.h"
-#include "../utils/bit.h"
+#include "fluorine/utils/bit.h"
 
 namespace flr
 {
@@ -26,12 +26,15 @@ namespace flr
     {
         nodes_ = 0;
         const int depth = state.board.count_empty();
+        SolveResult res;
         if (state.legal_moves == 0)
         {
-            const int score = -negascout(state.play_copied(Coords::none), -int_inf, int_inf, depth, true);
-            return {.traversed_nodes = nodes_, .score = static_cast<int>(score), .move = Coords::none};
+            res.score = -negascout(state.play_copied(Coords::none), -int_inf, int_inf, depth, true);
+            res.pv = principal_variation(state.play_copied(Coords::none), -res.score);
+            res.pv.insert(res.pv.begin(), Coords::none);
+            res.traversed_nodes = nodes_;
+            return res;
         }
-        SolveResult res;
         for (const int move : SetBits{state.legal_moves})
         {
             const Coords move_coords = static_cast<Coords>(move);
@@ -43,10 +46,83 @@ namespace flr
                 res.move = move_coords;
             }
         }
+        res.pv = principal_variation(state.play_copied(res.move), -res.score);
+        res.pv.insert(res.pv.begin(), res.move);
+        res.traversed_nodes = nodes_;
+        return res;
+    }
+
+    EndgameSolver::SolveAllResult EndgameSolver::solve_all(const GameState& state)
+    {
+        nodes_ = 0;
+        const int depth = state.board.count_empty();
+        SolveAllResult res;
+        if (state.legal_moves == 0)
+        {
+            const int score = -negascout(state.play_copied(Coords::none), -int_inf, int_inf, depth, true);
+            res.moves.push_back({Coords::none, score});
+            res.traversed_nodes = nodes_;
+            return res;
+        }
+        int best = -int_inf;
+        for (const Coords move : sort_moves_wrt_mobility(state))
+        {
+            const auto next = state.play_copied(move);
+            int score;
+            if (best == -int_inf)
+                score = -negascout(next, -int_inf, int_inf, depth - 1, false);
+            else
+            {
+                // Most moves are not better than the best one, the closed upper side of the window prunes a lot
+                score = -negascout(next, -best - 1, int_inf, depth - 1, false);
+                if (score > best) // Only a lower bound, re-search the upper half
+                    score = -negascout(next, -int_inf, -best, depth - 1, false);
+            }
+            best = std::max(best, score);
+            res.moves.push_back({move, score});
+        }
+        std::ranges::stable_sort(res.moves, std::greater{}, &MoveScore::score);
         res.traversed_nodes = nodes_;
         return res;
     }
 
+    // Walk down the tree, at each node following a move whose child proves the score. The table filled by the
+    // solve makes these searches cheap.
+    std::vector<Coords> EndgameSolver::principal_variation(GameState state, int score)
+    {
+        std::vector<Coords> pv;
+        while (true)
+        {
+            if (state.legal_moves == 0)
+            {
+                state.play(Coords::none);
+                if (state.legal_moves == 0) // Game over
+                    break;
+                pv.push_back(Coords::none);
+                score = -score;
+                continue;
+            }
+            const int depth = state.board.count_empty();
+            bool found = false;
+            for (const Coords move : sort_moves_wrt_mobility(state))
+            {
+                const auto next = state.play_copied(move);
+                // A window that only contains -score, returns exactly -score iff this move is on the PV
+                if (-negascout(next, -score - 1, -score + 1, depth - 1, false) == score)
+                {
+                    pv.push_back(move);
+                    state = next;
+                    score = -score;
+                    found = true;
+                    break;
+                }
+            }
+            if (!found)
+                break;
+        }
+        return pv;
+    }
+
     int EndgameSolver::negamax(const GameState& state, int alpha, const int beta, const int depth, const bool passed)
     {
         switch (depth)
@@ -103,9 +179,9 @@ namespace flr
         const int lookahead = static_cast<int>(state.current);
         const std::size_t hash = tt_.hash(state.board);
         Bounds<int> bounds{};
-        if (const auto* ptr = tt_.try_load(state.board, lookahead, hash))
+        if (const auto entry = tt_.try_load(state.board, lookahead, hash))
         {
-            bounds = *ptr;
+            bounds = *entry;
             const auto [lower, upper] = bounds;
             if (upper <= alpha) // alpha-cut
                 return upper;
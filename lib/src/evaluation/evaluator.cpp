@@ -1,12 +1,68 @@
 #include "fluorine/evaluation/evaluator.h"
 
 #include <fstream>
+#include <clu/random.h>
 
 namespace flr
 {
+    namespace
+    {
+        // The squared errors are summed in chunks so that the sums of large datasets do not lose precision
+        constexpr std::size_t mse_chunk_size = 256;
+
+        class ShuffledDataset final : public PreparedDataset
+        {
+        public:
+            ShuffledDataset(LearnableEvaluator& evaluator, Dataset& dataset) noexcept:
+                eval_(&evaluator), dataset_(&dataset)
+            {
+            }
+
+            float calculate_mse() const override
+            {
+                const Dataset& dataset = *dataset_;
+                float total_se = 0.0f;
+                for (std::size_t i = 0; i < dataset.size(); i += mse_chunk_size)
+                {
+                    const std::size_t end = std::min(i + mse_chunk_size, dataset.size());
+                    float chunk_se = 0.0f;
+                    for (std::size_t j = i; j < end; j++)
+                    {
+                        const float error = dataset[j].second.error(eval_->evaluate(dataset[j].first));
+                        chunk_se += error * error;
+                    }
+                    total_se += chunk_se;
+                }
+                return total_se / static_cast<float>(dataset.size());
+            }
+
+            float optimize_epoch(const std::size_t batch_size, const float lr) override
+            {
+                std::ranges::shuffle(*dataset_, clu::thread_rng());
+                return eval_->optimize(*dataset_, batch_size, lr);
+            }
+
+        private:
+            LearnableEvaluator* eval_;
+            Dataset* dataset_;
+        };
+    } // namespace
+
+    void Evaluator::evaluate_batch(const std::span<const Board> boards, const std::span<float> scores) const
+    {
+        assert(boards.size() == scores.size());
+        for (std::size_t i = 0; i < boards.size(); i++)
+            scores[i] = evaluate(boards[i]);
+    }
+
     void LearnableEvaluator::save(const std::filesystem::path& path) const
     {
         std::ofstream stream(path, std::ios::binary);
         save(stream);        
     }
+
+    std::unique_ptr<PreparedDataset> LearnableEvaluator::prepare_dataset(Dataset& dataset)
+    {
+        return std::make_unique<ShuffledDataset>(*this, dataset);
+    }
 } // namespace flr
@@ -3,7 +3,7 @@
 #include <clu/static_vector.h>
 
 #include "fluorine/core/game.h"
-#include "../utils/bit.h"
+#include "fluorine/utils/bit.h"
 
 namespace flr
 {
@@ -4,70 +4,165 @@
 #include <algorithm>
 #include <numeric>
 #include <array>
+#include <atomic>
+#include <barrier>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 #include <clu/random.h>
 #include <clu/static_vector.h>
 
-#include "../utils/bit.h"
+#include "midgame_searcher_impl.h"
+#include "pattern_utils.h"
+#include "../utils/mapped_file.h"
+#include "../utils/stream_io.h"
 
 namespace flr
 {
     namespace
     {
-        constexpr std::size_t max_pattern_size = 10;
         using Symmetry = LinearPatternEvaluator::Symmetry;
 
-        constexpr auto powers_of_3 = []
+        constexpr std::uint32_t packed_magic = 0x5752'4c46; // "FLRW"
+        constexpr std::uint32_t packed_version = 2;
+
+        // Ends the patterns of the original format instead of a zero mask when scalar features follow them. It is
+        // too large to be a pattern, so the versions without scalar features reject such files instead of silently
+        // dropping the features.
+        constexpr BitBoard scalar_features_marker = ~BitBoard{};
+
+        constexpr float adam_beta1 = 0.9f;
+        constexpr float adam_beta2 = 0.999f;
+        constexpr float optimizer_epsilon = 1e-8f;
+
+        // With several training threads, the gradients of each chunk of this many weights are applied by the same
+        // thread, which also keeps the cache lines of the optimizer state apart
+        constexpr std::size_t gradient_chunk_size = 64;
+
+        // Header of the packed format, followed by the pattern masks and the scalar features, all as 64-bit
+        // integers. The weight arena and the expanded weights are stored as laid out in memory, at offsets in bytes
+        // from the start of the file that are multiples of the cache line size.
+        // Version 1 had no scalar features, and its header ends before the count of them.
+        struct PackedHeader
         {
-            std::array<std::uint16_t, max_pattern_size + 1> res{1};
-            for (std::size_t i = 1; i < res.size(); i++)
-                res[i] = res[i - 1] * 3;
-            return res;
-        }();
+            std::uint32_t magic;
+            std::uint32_t version;
+            std::uint64_t stages;
+            std::uint64_t pattern_count;
+            std::uint64_t stage_weight_size;
+            std::uint64_t stage_table_size;
+            std::uint64_t weights_offset;
+            std::uint64_t expanded_offset;
+            std::uint64_t scalar_feature_count;
+        };
 
-        constexpr auto generate_2to3_table() noexcept
+        constexpr std::size_t packed_header_size(const std::uint32_t version) noexcept
         {
-            std::array<std::uint16_t, (1 << max_pattern_size)> table{};
-            for (std::size_t i = 0; i < table.size(); i++)
-                for (std::size_t j = 0; j < max_pattern_size; j++)
-                    table[i] += (i & (1ull << j)) ? powers_of_3[j] : std::uint16_t{};
-            return table;
+            return version == 1 ? offsetof(PackedHeader, scalar_feature_count) : sizeof(PackedHeader);
         }
 
-        // Reinterpret a binary number as a ternary number
-        constexpr auto binary_to_ternary_table = generate_2to3_table();
-
-        constexpr std::uint16_t extract_pattern(const Board board, const BitBoard pattern) noexcept
+        // The first word of the header has already been read to tell the formats apart
+        PackedHeader read_packed_header(std::istream& stream, const std::uint64_t first_word)
         {
-            const auto black = bit_compressr(board.black, pattern);
-            const auto white = bit_compressr(board.white, pattern);
-            return static_cast<std::uint16_t>(binary_to_ternary_table[black] + binary_to_ternary_table[white] * 2);
+            // Braced initializers are evaluated in order
+            PackedHeader header{
+                .magic = static_cast<std::uint32_t>(first_word),
+                .version = static_cast<std::uint32_t>(first_word >> 32),
+                .stages = read<std::uint64_t>(stream),
+                .pattern_count = read<std::uint64_t>(stream),
+                .stage_weight_size = read<std::uint64_t>(stream),
+                .stage_table_size = read<std::uint64_t>(stream),
+                .weights_offset = read<std::uint64_t>(stream),
+                .expanded_offset = read<std::uint64_t>(stream),
+                .scalar_feature_count = 0,
+            };
+            if (header.version != 1)
+                header.scalar_feature_count = read<std::uint64_t>(stream);
+            if (!stream)
+                throw std::runtime_error("Failed to read the header of the packed weights");
+            return header;
         }
 
-        // Get all the 8 possible rotoreflections of a board
-        constexpr auto transform_d4(const BitBoard mask) noexcept
+        void check_packed_header(const PackedHeader& header)
         {
-            const BitBoard flip = mirror_main_diagonal(mask);
-            return std::array{
-                mask, rotate_90_ccw(mask), rotate_180(mask), rotate_90_cw(mask), //
-                flip, rotate_90_ccw(flip), rotate_180(flip), rotate_90_cw(flip) //
-            };
+            if (header.magic != packed_magic)
+                throw std::runtime_error("Not a packed weights file");
+            if (header.version != 1 && header.version != packed_version)
+                throw std::runtime_error("Unsupported version of the packed weights format");
+            if (header.weights_offset % cache_line_size != 0 || header.expanded_offset % cache_line_size != 0)
+                throw std::runtime_error("Misaligned packed weights");
         }
 
-        BitBoard find_pattern_canonical_form(const BitBoard mask) noexcept
+        ScalarFeature to_scalar_feature(const std::uint64_t value)
         {
-            return std::ranges::min(transform_d4(mask));
+            if (value >= scalar_feature_count)
+                throw std::runtime_error("Unknown scalar feature");
+            return static_cast<ScalarFeature>(value);
         }
 
-        Symmetry find_pattern_symmetry(const BitBoard mask) noexcept
+        std::shared_ptr<const float> share(CacheAlignedVector<float>&& data)
         {
-            using enum Symmetry;
-            if (mask == mirror_horizontal(mask))
-                return axial;
-            if (mask == mirror_main_diagonal(mask))
-                return diagonal;
-            return none;
+            auto owner = std::make_shared<CacheAlignedVector<float>>(std::move(data));
+            return {owner, owner->data()};
         }
 
+        // Sums the weights of the pattern instances, instance_alignment of them at a time. The weight of an
+        // instance is at its table offset plus its index, so all of them can be fetched with gathers from one base.
+        class WeightSum
+        {
+        public:
+            void add(const float* table, const std::uint32_t* offsets, const std::uint16_t* indices) noexcept
+            {
+#if defined(__AVX512F__)
+                const __m512i idx = _mm512_cvtepu16_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(indices)));
+                const __m512i off = _mm512_loadu_si512(offsets);
+                acc_ = _mm512_add_ps(acc_, gather_ps<4>(_mm512_add_epi32(idx, off), table));
+#elif defined(__AVX2__)
+                const auto gather = [&](const std::size_t begin)
+                {
+                    const __m256i idx =
+                        _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(indices + begin)));
+                    const __m256i off = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(offsets + begin));
+                    return _mm256_i32gather_ps(table, _mm256_add_epi32(idx, off), 4);
+                };
+                low_ = _mm256_add_ps(low_, gather(0));
+                high_ = _mm256_add_ps(high_, gather(8));
+#else
+                for (std::size_t i = 0; i < instance_alignment; i++)
+                    acc_ += table[offsets[i] + indices[i]];
+#endif
+            }
+
+            [[nodiscard]] float sum() const noexcept
+            {
+#if defined(__AVX512F__)
+                return _mm512_reduce_add_ps(acc_);
+#elif defined(__AVX2__)
+                const __m256 acc = _mm256_add_ps(low_, high_);
+                __m128 res = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+                res = _mm_add_ps(res, _mm_movehl_ps(res, res));
+                res = _mm_add_ss(res, _mm_movehdup_ps(res));
+                return _mm_cvtss_f32(res);
+#else
+                return acc_;
+#endif
+            }
+
+        private:
+#if defined(__AVX512F__)
+            __m512 acc_ = _mm512_setzero_ps();
+#elif defined(__AVX2__)
+            // Two accumulators so that the additions of the two gathers do not wait for each other
+            __m256 low_ = _mm256_setzero_ps();
+            __m256 high_ = _mm256_setzero_ps();
+#else
+            float acc_ = 0.0f;
+#endif
+        };
+
         std::vector<std::uint16_t> generate_pattern_index_map(const BitBoard mask, const Symmetry symmetry)
         {
             if (static_cast<std::size_t>(std::popcount(mask)) > max_pattern_size)
@@ -82,18 +177,23 @@ namespace flr
 
             // Get reflect map
             const auto reflect = symmetry == diagonal ? &mirror_main_diagonal : &mirror_horizontal;
-            for (std::size_t i = 0; i < 1ull << pattern_size; i++)
-                for (std::size_t j = 0; j < 1ull << pattern_size; j++)
+            const std::size_t full = (1ull << pattern_size) - 1;
+            for (std::size_t i = 0; i <= full; i++)
+            {
+                const BitBoard black = reflect(bit_expandr(i, mask));
+                // Only visit the white disks that fit in the squares not taken by black
+                const std::size_t empty = full & ~i;
+                for (std::size_t j = empty;; j = (j - 1) & empty)
                 {
-                    if (i & j)
-                        continue;
                     const auto first =
                         static_cast<std::uint16_t>(binary_to_ternary_table[i] + binary_to_ternary_table[j] * 2);
-                    const BitBoard black = reflect(bit_expandr(i, mask));
                     const BitBoard white = reflect(bit_expandr(j, mask));
                     const auto second = extract_pattern({black, white}, mask);
                     map[first] = std::min(first, second);
+                    if (j == 0)
+                        break;
                 }
+            }
 
             // Compress unused indices
             std::vector<bool> occupied(map.size());
@@ -111,109 +211,582 @@ namespace flr
             return map;
         }
 
-        template <typename T>
-            requires std::is_trivial_v<T>
-        T read(std::istream& stream)
+        // Index maps only depend on the pattern, so they are built once and shared by every evaluator
+        std::shared_ptr<const std::vector<std::uint16_t>> cached_pattern_index_map(
+            const BitBoard mask, const Symmetry symmetry)
         {
-            T value;
-            stream.read(reinterpret_cast<char*>(&value), sizeof(T));
-            return value;
-        }
-
-        template <typename T>
-            requires std::is_trivial_v<T>
-        void write(std::ostream& stream, const T& value)
-        {
-            stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+            static std::mutex mutex;
+            static std::unordered_map<BitBoard, std::shared_ptr<const std::vector<std::uint16_t>>> cache;
+            {
+                std::scoped_lock lock(mutex);
+                if (const auto iter = cache.find(mask); iter != cache.end())
+                    return iter->second;
+            }
+            // Not built under the lock so that loading other patterns is not blocked,
+            // if another thread builds the same map at the same time the first one is kept
+            auto map = std::make_shared<const std::vector<std::uint16_t>>(generate_pattern_index_map(mask, symmetry));
+            std::scoped_lock lock(mutex);
+            return cache.try_emplace(mask, std::move(map)).first->second;
         }
     } // namespace
 
-    LinearPatternEvaluator::LinearPatternEvaluator(const std::span<const BitBoard> patterns, const std::size_t stages):
+    LinearPatternEvaluator::LinearPatternEvaluator(const std::span<const BitBoard> patterns, const std::size_t stages,
+        const std::span<const ScalarFeature> scalar_features):
         stages_(stages)
     {
         assert(stages > 0);
         patterns_.reserve(patterns.size());
         for (const auto& pattern : patterns)
-            patterns_.emplace_back(pattern, stages_);
+            patterns_.emplace_back(pattern);
+        for (const auto feature : scalar_features)
+        {
+            if (std::ranges::find(scalar_features_, feature) != scalar_features_.end())
+                throw std::runtime_error("Duplicated scalar feature");
+            scalar_features_.push_back(feature);
+        }
+        layout_weights();
+        build_instance_tables();
+        expand_weights();
     }
 
     std::unique_ptr<Evaluator> LinearPatternEvaluator::clone() const
     {
+        // The weights are shared with the clone, and copied if either of them gets trained
         auto res = std::unique_ptr<LinearPatternEvaluator>(new LinearPatternEvaluator);
+        res->stages_ = stages_;
         res->patterns_ = patterns_;
+        res->scalar_features_ = scalar_features_;
+        res->weights_ = weights_;
+        res->weights_writable_ = weights_writable_;
+        res->stage_weight_size_ = stage_weight_size_;
+        res->scalar_weight_offset_ = scalar_weight_offset_;
+        res->training_threads_ = training_threads_;
+        res->parallel_stages_ = parallel_stages_;
+        res->optimizer_ = optimizer_;
+        res->build_instance_tables();
+        res->expanded_weights_ = expanded_weights_;
+        return res;
+    }
+
+    void LinearPatternEvaluator::add_pattern(const BitBoard pattern)
+    {
+        patterns_.emplace_back(pattern);
+        layout_weights(scalar_features_.size());
+        build_instance_tables();
+        expand_weights();
+    }
+
+    void LinearPatternEvaluator::add_scalar_feature(const ScalarFeature feature)
+    {
+        if (std::ranges::find(scalar_features_, feature) != scalar_features_.end())
+            throw std::runtime_error("Duplicated scalar feature");
+        scalar_features_.push_back(feature);
+        layout_weights(scalar_features_.size() - 1);
+    }
+
+    LinearPatternEvaluator::FeatureState LinearPatternEvaluator::features_of(const Board& board) const
+    {
+        FeatureState res;
+        res.indices_.resize(feature_size_);
+        update_features(res, Board::empty, board);
         return res;
     }
 
+    void LinearPatternEvaluator::update_features(FeatureState& features, const Board& from, const Board& to) const noexcept
+    {
+        update_feature_indices(
+            features.indices_.data(), feature_size_, black_deltas_.data(), white_deltas_.data(), from, to);
+    }
+
+    float LinearPatternEvaluator::evaluate(const GameState& state, const FeatureState& features) const noexcept
+    {
+        const std::size_t stage = stage_of(state.board);
+        if (stage == stages_) [[unlikely]]
+            return static_cast<float>(state.disk_difference());
+        const float* table = expanded_weights_.get() + stage * stage_table_size_;
+        const std::uint16_t* indices =
+            features.indices_.data() + (state.current == Color::black ? 0 : padded_instance_count_);
+        WeightSum sum;
+        for (std::size_t i = 0; i < padded_instance_count_; i += instance_alignment)
+            sum.add(table, instance_offsets_.data() + i, indices + i);
+        return sum.sum() + evaluate_scalars(state.canonical_board(), stage);
+    }
+
+    int LinearPatternEvaluator::evaluate_fixed(const GameState& state, const FeatureState& features) const noexcept
+    {
+        return to_fixed_score(evaluate(state, features));
+    }
+
     float LinearPatternEvaluator::evaluate(const Board& board) const
     {
         const std::size_t stage = stage_of(board);
         if (stage == stages_) [[unlikely]]
             return static_cast<float>(board.disk_difference());
+        return evaluate_transformed(transform_d4(board.black), transform_d4(board.white), stage) +
+            evaluate_scalars(board, stage);
+    }
+
+    float LinearPatternEvaluator::evaluate_scalars(const Board& board, const std::size_t stage) const noexcept
+    {
+        const auto weights = scalar_weights_at_stage(stage);
         float res = 0.0f;
+        for (std::size_t i = 0; i < scalar_features_.size(); i++)
+            res += weights[i] * static_cast<float>(scalar_feature_value(scalar_features_[i], board));
+        return res * scalar_feature_scale;
+    }
+
+    float LinearPatternEvaluator::compute_gradients(
+        const DataPoint& point, const float mult, std::vector<GradientUpdate>& updates) const
+    {
+        const auto& [board, bounds] = point;
+        const std::size_t stage = stage_of(board);
+        if (stage == stages_) [[unlikely]]
+            return 0.0f;
+        const std::size_t first_update = updates.size();
         const auto self_d4 = transform_d4(board.black);
         const auto opponent_d4 = transform_d4(board.white);
+        float predicted = 0.0f;
         for (const auto& pattern : patterns_)
         {
-            const std::size_t n = pattern.symmetry == Symmetry::none ? 8 : 4;
-            const auto weights = pattern.weights_at_stage(stage);
-            for (std::size_t i = 0; i < n; i++)
+            const std::size_t sym = instance_count_of(pattern.symmetry);
+            const auto weights = weights_at_stage(pattern, stage);
+            const auto offset = static_cast<std::uint32_t>(stage * stage_weight_size_ + pattern.offset);
+            for (std::size_t k = 0; k < sym; k++)
             {
-                const auto idx = extract_pattern({self_d4[i], opponent_d4[i]}, pattern.pattern);
-                res += weights[pattern.index_map[idx]];
+                const auto idx = pattern.extractor({self_d4[k], opponent_d4[k]});
+                const auto mapped = (*pattern.index_map)[idx];
+                updates.push_back({offset + mapped, 0.0f});
+                predicted += weights[mapped];
             }
         }
-        return res;
+        std::array<float, scalar_feature_count> scalar_values; // NOLINT(cppcoreguidelines-pro-type-member-init)
+        const auto scalar_weights = scalar_weights_at_stage(stage);
+        for (std::size_t k = 0; k < scalar_features_.size(); k++)
+        {
+            scalar_values[k] =
+                static_cast<float>(scalar_feature_value(scalar_features_[k], board)) * scalar_feature_scale;
+            predicted += scalar_weights[k] * scalar_values[k];
+        }
+        return finish_gradients(predicted, bounds, mult, stage, scalar_values.data(), first_update, updates);
     }
 
-    float LinearPatternEvaluator::optimize(
-        const std::span<const DataPoint> dataset, const std::size_t batch_size, const float lr)
+    // Same as above with the indices and the scalar values read from the row, the floating point operations are
+    // done in the same order so that the weights are exactly the same
+    float LinearPatternEvaluator::compute_gradients(
+        const FeatureCache& cache, const std::size_t row, const float mult, std::vector<GradientUpdate>& updates) const
     {
+        const std::uint16_t* data = cache.row(row);
+        const std::size_t stage = data[0];
+        if (stage == stages_) [[unlikely]]
+            return 0.0f;
+        const std::size_t first_update = updates.size();
+        const std::uint16_t* indices = data + 1;
+        float predicted = 0.0f;
+        for (const auto& pattern : patterns_)
+        {
+            const std::size_t sym = instance_count_of(pattern.symmetry);
+            const auto weights = weights_at_stage(pattern, stage);
+            const auto offset = static_cast<std::uint32_t>(stage * stage_weight_size_ + pattern.offset);
+            for (std::size_t k = 0; k < sym; k++)
+            {
+                const auto mapped = *indices++;
+                updates.push_back({offset + mapped, 0.0f});
+                predicted += weights[mapped];
+            }
+        }
+        std::array<float, scalar_feature_count> scalar_values; // NOLINT(cppcoreguidelines-pro-type-member-init)
+        const auto scalar_weights = scalar_weights_at_stage(stage);
+        for (std::size_t k = 0; k < scalar_features_.size(); k++)
+        {
+            scalar_values[k] = static_cast<float>(indices[k]) * scalar_feature_scale;
+            predicted += scalar_weights[k] * scalar_values[k];
+        }
+        return finish_gradients(
+            predicted, cache.bounds_[row], mult, stage, scalar_values.data(), first_update, updates);
+    }
+
+    float LinearPatternEvaluator::finish_gradients(const float predicted, const Bounds<float> bounds,
+        const float mult, const std::size_t stage, const float* scalar_values, const std::size_t first_update,
+        std::vector<GradientUpdate>& updates) const
+    {
+        const float error = bounds.error(predicted);
+        if (error == 0.0f)
+        {
+            updates.resize(first_update);
+            return 0.0f;
+        }
+        const float grad = std::clamp(mult * error, -2.0f, 2.0f); // Clip gradient
+        for (std::size_t k = first_update; k < updates.size(); k++)
+            updates[k].gradient = grad;
+        const auto scalar_offset =
+            static_cast<std::uint32_t>(stage * stage_weight_size_ + scalar_weight_offset_);
+        for (std::size_t k = 0; k < scalar_features_.size(); k++)
+            updates.push_back({scalar_offset + static_cast<std::uint32_t>(k), grad * scalar_values[k]});
+        return error;
+    }
+
+    float LinearPatternEvaluator::evaluate_transformed(
+        const std::array<BitBoard, 8>& self_d4, const std::array<BitBoard, 8>& opponent_d4, const std::size_t stage) const
+    {
+        const float* table = expanded_weights_.get() + stage * stage_table_size_;
+        WeightSum sum;
+        for_each_index_chunk(patterns_, self_d4, opponent_d4, [&](const std::size_t begin, const std::uint16_t* indices)
+            { sum.add(table, instance_offsets_.data() + begin, indices); });
+        return sum.sum();
+    }
+
+    // Overridden so that calls on the final class resolve evaluate statically as well
+    int LinearPatternEvaluator::evaluate_fixed(const Board& board) const { return to_fixed_score(evaluate(board)); }
+
+    void LinearPatternEvaluator::start_optimizer_step(
+        const float lr, const std::size_t stage_begin, const std::size_t stage_end) noexcept
+    {
+        // Every stage takes an Adam step, the weights unused by the batch are only updated the next time they are
+        // used, with their moments decayed for all the steps they missed
+        if (optimizer_ != Optimizer::adam)
+            return;
+        for (std::size_t stage = stage_begin; stage < stage_end; stage++)
+        {
+            const auto step = static_cast<float>(++steps_[stage]);
+            step_sizes_[stage] =
+                lr * std::sqrt(1.0f - std::pow(adam_beta2, step)) / (1.0f - std::pow(adam_beta1, step));
+        }
+    }
+
+    void LinearPatternEvaluator::apply_gradients(
+        const std::span<const std::vector<GradientUpdate>> parts, float* weights, const float lr) noexcept
+    {
+        for (const auto& part : parts)
+            for (const auto [offset, gradient] : part)
+                gradients_[offset] += gradient;
+        switch (optimizer_)
+        {
+            case Optimizer::sgd:
+                for (const auto& part : parts)
+                    for (const auto [offset, _] : part)
+                    {
+                        weights[offset] -= gradients_[offset];
+                        gradients_[offset] = 0.0f;
+                    }
+                break;
+            case Optimizer::adagrad:
+                // The gradient of a weight used more than once is zero after the first time, which changes nothing
+                for (const auto& part : parts)
+                    for (const auto [offset, _] : part)
+                    {
+                        const float gradient = gradients_[offset];
+                        float& sum = optimizer_state_[offset];
+                        sum += gradient * gradient;
+                        weights[offset] -= lr * gradient / (std::sqrt(sum) + optimizer_epsilon);
+                        gradients_[offset] = 0.0f;
+                    }
+                break;
+            case Optimizer::adam:
+                for (const auto& part : parts)
+                    for (const auto [offset, _] : part)
+                    {
+                        const std::size_t stage = offset / stage_weight_size_;
+                        const std::uint32_t step = steps_[stage];
+                        auto& last_step = last_steps_[offset];
+                        if (last_step == step) // Already updated by this batch
+                            continue;
+                        float& first_moment = optimizer_state_[2 * offset];
+                        float& second_moment = optimizer_state_[2 * offset + 1];
+                        if (const std::uint32_t missed = step - last_step - 1; missed > 0)
+                        {
+                            first_moment *= std::pow(adam_beta1, static_cast<float>(missed));
+                            second_moment *= std::pow(adam_beta2, static_cast<float>(missed));
+                        }
+                        last_step = step;
+                        const float gradient = gradients_[offset];
+                        first_moment = adam_beta1 * first_moment + (1.0f - adam_beta1) * gradient;
+                        second_moment = adam_beta2 * second_moment + (1.0f - adam_beta2) * gradient * gradient;
+                        weights[offset] -=
+                            step_sizes_[stage] * first_moment / (std::sqrt(second_moment) + optimizer_epsilon);
+                        gradients_[offset] = 0.0f;
+                    }
+                break;
+        }
+    }
+
+    template <typename StageOf, typename ComputeGradients>
+    float LinearPatternEvaluator::optimize_points(const std::size_t size, const std::size_t batch_size, const float lr,
+        StageOf&& stage_of_point, ComputeGradients&& compute)
+    {
+        // The batches would never advance through the data
+        if (batch_size == 0)
+            throw std::runtime_error("The batch size must be positive");
+        const std::size_t arena_size = stages_ * stage_weight_size_;
+        if (gradients_.empty())
+            gradients_.resize(arena_size);
+        if (optimizer_state_.empty() && optimizer_ != Optimizer::sgd)
+        {
+            const bool adam = optimizer_ == Optimizer::adam;
+            optimizer_state_.resize(adam ? arena_size * 2 : arena_size);
+            last_steps_.assign(adam ? arena_size : 0, 0);
+            steps_.assign(stages_, 0);
+            step_sizes_.assign(stages_, 0.0f);
+        }
+        float* weights = mutable_weights(); // Copied before any thread reads the arena
+        const float total_se = parallel_stages_ && stages_ > 1
+            ? optimize_stages(size, batch_size, lr, weights, stage_of_point, compute)
+            : optimize_batches(size, batch_size, lr, training_threads_, weights, 0, stages_, compute);
+        expand_weights();
+        return total_se / static_cast<float>(size);
+    }
+
+    template <typename ComputeGradients>
+    float LinearPatternEvaluator::optimize_batches(const std::size_t size, const std::size_t batch_size,
+        const float lr, const std::size_t threads, float* weights, const std::size_t stage_begin,
+        const std::size_t stage_end, ComputeGradients&& compute)
+    {
+        // A batch only touches a few hundred weights, so the gradients are accumulated sparsely, and only the
+        // touched ones are applied and zeroed. An offset may be touched more than once, its gradient is just zero
+        // after the first time it is applied. The gradients stay all zero between batches, and between calls.
+        const std::size_t thread_count = std::max<std::size_t>(1, std::min(threads, batch_size));
+        std::vector<std::vector<GradientUpdate>> shards(thread_count);
+        for (auto& shard : shards)
+            shard.reserve(batch_size * (padded_instance_count_ + scalar_features_.size()) / thread_count);
+        std::vector<float> errors(batch_size);
+        std::size_t batch_begin = 0;
         float total_se = 0.0f;
-        std::vector<float*> updated_params;
-        updated_params.reserve(patterns_.size() * 8);
-        for (std::size_t i = 0; i < dataset.size(); i += batch_size)
-        {
-            for (auto& pattern : patterns_)
-                pattern.reset_gradients();
-            const std::size_t end = std::min(dataset.size(), i + batch_size);
-            const float mult = 2.0f * lr / static_cast<float>(end - i);
+
+        // Each thread takes a contiguous part of the batch, so that reducing the shards in order adds up the
+        // gradients in the order of the data
+        const auto compute_shard = [&](const std::size_t thread)
+        {
+            const std::size_t count = std::min(size, batch_begin + batch_size) - batch_begin;
+            // The adaptive optimizers apply the learning rate themselves
+            const float mult = 2.0f * (optimizer_ == Optimizer::sgd ? lr : 1.0f) / static_cast<float>(count);
+            auto& shard = shards[thread];
+            shard.clear();
+            for (std::size_t i = count * thread / thread_count; i < count * (thread + 1) / thread_count; i++)
+                errors[i] = compute(batch_begin + i, mult, shard);
+        };
+        const auto start_step = [&]() noexcept
+        {
+            const std::size_t count = std::min(size, batch_begin + batch_size) - batch_begin;
             float batch_se = 0.0f;
-            for (std::size_t j = i; j < end; j++)
+            for (std::size_t i = 0; i < count; i++)
+                batch_se += errors[i] * errors[i];
+            total_se += batch_se;
+            start_optimizer_step(lr, stage_begin, stage_end);
+        };
+
+        if (thread_count == 1)
+        {
+            for (; batch_begin < size; batch_begin += batch_size)
             {
-                updated_params.clear();
-                const auto& [board, bounds] = dataset[j];
-                const std::size_t stage = stage_of(board);
-                if (stage == stages_) [[unlikely]]
-                    continue;
-                const auto self_d4 = transform_d4(board.black);
-                const auto opponent_d4 = transform_d4(board.white);
-                float predicted = 0.0f;
-                for (auto& pattern : patterns_)
+                compute_shard(0);
+                start_step();
+                apply_gradients(shards, weights, lr);
+            }
+            return total_se;
+        }
+
+        // The updates of each thread are split by the chunk of their offset, ranges[chunk_owner * thread_count +
+        // thread] are the updates of a thread for the chunks applied by chunk_owner. Every offset is thus applied
+        // by one thread, which adds up its gradients in the order of the threads, that is the order of the data.
+        std::vector<std::vector<GradientUpdate>> ranges(thread_count * thread_count);
+        // The weights are read by all the threads while computing the gradients, and each thread only updates its
+        // own chunks of them between the two barriers
+        std::barrier computed(static_cast<std::ptrdiff_t>(thread_count), start_step);
+        std::barrier applied(static_cast<std::ptrdiff_t>(thread_count), [&]() noexcept { batch_begin += batch_size; });
+        const auto work = [&](const std::size_t thread)
+        {
+            while (batch_begin < size)
+            {
+                compute_shard(thread);
+                for (std::size_t owner = 0; owner < thread_count; owner++)
+                    ranges[owner * thread_count + thread].clear();
+                for (const auto update : shards[thread])
                 {
-                    const std::size_t sym = pattern.symmetry == Symmetry::none ? 8 : 4;
-                    const auto weights = pattern.weights_at_stage(stage);
-                    const auto grads = pattern.gradients_at_stage(stage);
-                    for (std::size_t k = 0; k < sym; k++)
-                    {
-                        const auto idx = extract_pattern({self_d4[k], opponent_d4[k]}, pattern.pattern);
-                        const auto mapped = pattern.index_map[idx];
-                        updated_params.push_back(&grads[mapped]);
-                        predicted += weights[mapped];
-                    }
+                    const std::size_t owner = update.offset / gradient_chunk_size % thread_count;
+                    ranges[owner * thread_count + thread].push_back(update);
                 }
-                const float error = bounds.error(predicted);
-                if (error == 0.0f)
-                    continue;
-                batch_se += error * error;
-                const float grad = std::clamp(mult * error, -2.0f, 2.0f); // Clip gradient
-                for (float* g : updated_params)
-                    *g += grad;
+                computed.arrive_and_wait();
+                apply_gradients({ranges.data() + thread * thread_count, thread_count}, weights, lr);
+                applied.arrive_and_wait();
             }
-            total_se += batch_se;
-            for (auto& pattern : patterns_)
-                pattern.apply_gradients();
+        };
+        std::vector<std::thread> workers;
+        workers.reserve(thread_count - 1);
+        for (std::size_t i = 1; i < thread_count; i++)
+            workers.emplace_back(work, i);
+        work(0);
+        for (auto& worker : workers)
+            worker.join();
+        return total_se;
+    }
+
+    template <typename StageOf, typename ComputeGradients>
+    float LinearPatternEvaluator::optimize_stages(const std::size_t size, const std::size_t batch_size,
+        const float lr, float* weights, StageOf&& stage_of_point, ComputeGradients&& compute)
+    {
+        // Stages share no weights, and their parts of the arena are padded to whole cache lines, so each one is
+        // trained on its own without any synchronization, and the result does not depend on the thread count
+        std::vector<std::vector<std::uint32_t>> parts(stages_);
+        for (std::size_t i = 0; i < size; i++)
+            if (const std::size_t stage = stage_of_point(i); stage < stages_)
+                parts[stage].push_back(static_cast<std::uint32_t>(i));
+        std::vector<float> stage_se(stages_);
+        std::atomic<std::size_t> next_stage = 0;
+        const auto work = [&]
+        {
+            for (std::size_t stage; (stage = next_stage.fetch_add(1, std::memory_order_relaxed)) < stages_;)
+            {
+                const auto& part = parts[stage];
+                stage_se[stage] = optimize_batches(part.size(), batch_size, lr, 1, weights, stage, stage + 1,
+                    [&](const std::size_t i, const float mult, std::vector<GradientUpdate>& updates)
+                    { return compute(part[i], mult, updates); });
+            }
+        };
+        const std::size_t thread_count = std::min(training_threads_, stages_);
+        std::vector<std::thread> workers;
+        workers.reserve(thread_count - 1);
+        for (std::size_t i = 1; i < thread_count; i++)
+            workers.emplace_back(work);
+        work();
+        for (auto& worker : workers)
+            worker.join();
+        float total_se = 0.0f;
+        for (const float se : stage_se)
+            total_se += se;
+        return total_se;
+    }
+
+    float LinearPatternEvaluator::optimize(
+        const std::span<const DataPoint> dataset, const std::size_t batch_size, const float lr)
+    {
+        return optimize_points(
+            dataset.size(), batch_size, lr, [&](const std::size_t i) { return stage_of(dataset[i].first); },
+            [&](const std::size_t i, const float mult, std::vector<GradientUpdate>& updates)
+            { return compute_gradients(dataset[i], mult, updates); });
+    }
+
+    LinearPatternEvaluator::FeatureCache LinearPatternEvaluator::build_feature_cache(
+        const std::span<const DataPoint> dataset) const
+    {
+        FeatureCache res;
+        res.stages_ = stages_;
+        res.patterns_.reserve(patterns_.size());
+        std::size_t instance_count = 0;
+        for (const auto& pattern : patterns_)
+        {
+            res.patterns_.push_back(pattern.pattern);
+            instance_count += instance_count_of(pattern.symmetry);
+        }
+        res.scalar_features_ = scalar_features_;
+        res.row_size_ = 1 + instance_count + scalar_features_.size();
+        res.rows_.resize(dataset.size() * res.row_size_);
+        res.bounds_.reserve(dataset.size());
+        res.order_.resize(dataset.size());
+        std::iota(res.order_.begin(), res.order_.end(), std::uint32_t{});
+        std::uint16_t* row = res.rows_.data();
+        for (const auto& [board, bounds] : dataset)
+        {
+            res.bounds_.push_back(bounds);
+            const std::size_t stage = stage_of(board);
+            row[0] = static_cast<std::uint16_t>(stage);
+            if (stage == stages_) [[unlikely]]
+            {
+                const float error = bounds.error(static_cast<float>(board.disk_difference()));
+                res.final_se_ += error * error;
+            }
+            else
+            {
+                std::uint16_t* indices = row + 1;
+                const auto self_d4 = transform_d4(board.black);
+                const auto opponent_d4 = transform_d4(board.white);
+                for (const auto& pattern : patterns_)
+                    for (std::size_t k = 0; k < instance_count_of(pattern.symmetry); k++)
+                        *indices++ = (*pattern.index_map)[pattern.extractor({self_d4[k], opponent_d4[k]})];
+                for (const auto feature : scalar_features_)
+                    *indices++ = static_cast<std::uint16_t>(scalar_feature_value(feature, board));
+            }
+            row += res.row_size_;
+        }
+        return res;
+    }
+
+    float LinearPatternEvaluator::optimize(const FeatureCache& cache, const std::size_t batch_size, const float lr)
+    {
+        check_feature_cache(cache);
+        return optimize_points(
+            cache.size(), batch_size, lr, [&](const std::size_t i) { return std::size_t{*cache.row(cache.order_[i])}; },
+            [&](const std::size_t i, const float mult, std::vector<GradientUpdate>& updates)
+            { return compute_gradients(cache, cache.order_[i], mult, updates); });
+    }
+
+    float LinearPatternEvaluator::calculate_mse(const FeatureCache& cache) const
+    {
+        check_feature_cache(cache);
+        float total_se = 0.0f;
+        std::vector<GradientUpdate> updates; // Only the errors are needed, the gradients are thrown away
+        for (std::size_t i = 0; i < cache.size(); i++)
+        {
+            updates.clear();
+            const float error = compute_gradients(cache, i, 0.0f, updates);
+            total_se += error * error;
         }
-        return total_se / static_cast<float>(dataset.size());
+        return (total_se + cache.final_se_) / static_cast<float>(cache.size());
+    }
+
+    namespace
+    {
+        // The patterns of the data are only extracted once, shuffling the cache is the same as shuffling the data
+        class CachedDataset final : public PreparedDataset
+        {
+        public:
+            CachedDataset(LinearPatternEvaluator& evaluator, const Dataset& dataset):
+                eval_(&evaluator), cache_(evaluator.build_feature_cache(dataset))
+            {
+            }
+
+            float calculate_mse() const override { return eval_->calculate_mse(cache_); }
+
+            float optimize_epoch(const std::size_t batch_size, const float lr) override
+            {
+                cache_.shuffle(clu::thread_rng());
+                return eval_->optimize(cache_, batch_size, lr);
+            }
+
+        private:
+            LinearPatternEvaluator* eval_;
+            LinearPatternEvaluator::FeatureCache cache_;
+        };
+    } // namespace
+
+    std::unique_ptr<PreparedDataset> LinearPatternEvaluator::prepare_dataset(Dataset& dataset)
+    {
+        return std::make_unique<CachedDataset>(*this, dataset);
+    }
+
+    void LinearPatternEvaluator::configure_training(const TrainingConfig& config)
+    {
+        training_threads_ = std::max<std::size_t>(config.threads, 1);
+        parallel_stages_ = config.parallel_stages;
+        if (config.optimizer != optimizer_)
+        {
+            optimizer_ = config.optimizer;
+            reset_optimizer_state();
+        }
+    }
+
+    void LinearPatternEvaluator::reset_optimizer_state() noexcept
+    {
+        optimizer_state_.clear();
+        last_steps_.clear();
+        steps_.clear();
+        step_sizes_.clear();
+    }
+
+    void LinearPatternEvaluator::check_feature_cache(const FeatureCache& cache) const
+    {
+        const bool same_patterns = std::ranges::equal(
+            cache.patterns_, patterns_, {}, {}, [](const Pattern& pattern) { return pattern.pattern; });
+        if (cache.stages_ != stages_ || !same_patterns || cache.scalar_features_ != scalar_features_)
+            throw std::runtime_error("The feature cache was built for another evaluator");
     }
 
     void LinearPatternEvaluator::randomize_weights()
@@ -222,97 +795,345 @@ namespace flr
         const float stddev = 1.0f / static_cast<float>(patterns_.size());
         auto& rng = clu::thread_rng();
         std::normal_distribution dist(0.0f, stddev);
-        for (auto& pattern : patterns_)
-            for (auto& weight : pattern.weights)
+        float* weights = mutable_weights();
+        for (const auto& pattern : patterns_)
+            for (std::size_t stage = 0; stage < stages_; stage++)
+                for (auto& weight : std::span(weights + stage * stage_weight_size_ + pattern.offset, pattern.count))
+                    weight = dist(rng);
+        for (std::size_t stage = 0; stage < stages_; stage++)
+            for (auto& weight : std::span(weights + stage * stage_weight_size_ + scalar_weight_offset_,
+                     scalar_features_.size()))
                 weight = dist(rng);
+        expand_weights();
     }
 
     std::unique_ptr<LinearPatternEvaluator> LinearPatternEvaluator::load(std::istream& stream)
     {
         auto res = std::unique_ptr<LinearPatternEvaluator>(new LinearPatternEvaluator);
-        res->stages_ = read<std::size_t>(stream);
+        // The original format starts with the stage count, which is never as large as the magic number
+        const auto first_word = read<std::uint64_t>(stream);
+        if (!stream)
+            throw std::runtime_error("Failed to read the weights");
+        if (static_cast<std::uint32_t>(first_word) == packed_magic)
+        {
+            const auto header = read_packed_header(stream, first_word);
+            check_packed_header(header);
+            std::vector<BitBoard> masks(header.pattern_count);
+            for (auto& mask : masks)
+                mask = read<BitBoard>(stream);
+            std::vector<ScalarFeature> features(header.scalar_feature_count);
+            for (auto& feature : features)
+                feature = to_scalar_feature(read<std::uint64_t>(stream));
+            if (!stream)
+                throw std::runtime_error("Failed to read the packed weights");
+            res->load_packed_layout(header.stages, masks, features, header.stage_weight_size, header.stage_table_size);
+            std::uint64_t position =
+                packed_header_size(header.version) + (masks.size() + features.size()) * sizeof(std::uint64_t);
+            const auto read_floats = [&](const std::uint64_t offset, const std::size_t size)
+            {
+                if (offset < position)
+                    throw std::runtime_error("Overlapping sections in the packed weights");
+                stream.ignore(static_cast<std::streamsize>(offset - position));
+                CacheAlignedVector<float> data(size);
+                stream.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(size * sizeof(float)));
+                if (!stream)
+                    throw std::runtime_error("Failed to read the packed weights");
+                position = offset + size * sizeof(float);
+                return share(std::move(data));
+            };
+            res->weights_ = read_floats(header.weights_offset, res->stages_ * res->stage_weight_size_);
+            res->weights_writable_ = true;
+            res->expanded_weights_ = read_floats(header.expanded_offset, res->stages_ * res->stage_table_size_);
+            return res;
+        }
+
+        res->stages_ = first_word;
+        // The weights of each pattern are stored together, so they are only put into the arena at the end
+        std::vector<std::vector<float>> weights;
+        BitBoard mask = 0;
         while (true)
         {
-            Pattern pattern = Pattern::load(stream, res->stages_);
-            if (pattern.pattern == 0)
-                return res;
-            res->patterns_.push_back(std::move(pattern));
+            mask = read<BitBoard>(stream);
+            if (!stream)
+                throw std::runtime_error("Failed to read the weights");
+            if (mask == 0 || mask == scalar_features_marker)
+                break;
+            const auto& pattern = res->patterns_.emplace_back(mask);
+            auto& pattern_weights = weights.emplace_back(res->stages_ * pattern.count);
+            stream.read(reinterpret_cast<char*>(pattern_weights.data()),
+                static_cast<std::streamsize>(sizeof(float) * pattern_weights.size()));
+        }
+        std::vector<float> scalar_weights;
+        if (mask == scalar_features_marker)
+        {
+            res->scalar_features_.resize(read<std::uint64_t>(stream));
+            for (auto& feature : res->scalar_features_)
+                feature = to_scalar_feature(read<std::uint64_t>(stream));
+            scalar_weights.resize(res->stages_ * res->scalar_features_.size());
+            stream.read(reinterpret_cast<char*>(scalar_weights.data()),
+                static_cast<std::streamsize>(sizeof(float) * scalar_weights.size()));
+        }
+        if (!stream)
+            throw std::runtime_error("Failed to read the weights");
+        res->layout_weights();
+        float* arena = res->mutable_weights();
+        for (std::size_t i = 0; i < res->patterns_.size(); i++)
+        {
+            const auto& pattern = res->patterns_[i];
+            for (std::size_t stage = 0; stage < res->stages_; stage++)
+                std::ranges::copy(std::span(weights[i]).subspan(stage * pattern.count, pattern.count),
+                    arena + stage * res->stage_weight_size_ + pattern.offset);
         }
+        const std::size_t scalar_count = res->scalar_features_.size();
+        for (std::size_t stage = 0; stage < res->stages_; stage++)
+            std::ranges::copy(std::span(scalar_weights).subspan(stage * scalar_count, scalar_count),
+                arena + stage * res->stage_weight_size_ + res->scalar_weight_offset_);
+        res->build_instance_tables();
+        res->expand_weights();
+        return res;
     }
 
     std::unique_ptr<LinearPatternEvaluator> LinearPatternEvaluator::load(const std::filesystem::path& path)
     {
-        std::ifstream stream(path, std::ios::binary);
-        return load(stream);
+        {
+            std::ifstream stream(path, std::ios::binary);
+            const auto magic = read<std::uint32_t>(stream);
+            if (!stream || magic != packed_magic)
+            {
+                stream.clear();
+                stream.seekg(0);
+                return load(stream);
+            }
+        }
+
+        const auto file = std::make_shared<const MappedFile>(path);
+        const auto bytes = file->bytes();
+        PackedHeader header{}; // The count of scalar features is zero if the header is of version 1
+        if (bytes.size() < packed_header_size(1))
+            throw std::runtime_error("Truncated packed weights");
+        std::memcpy(&header, bytes.data(), packed_header_size(1));
+        check_packed_header(header);
+        const std::size_t header_size = packed_header_size(header.version);
+        if (bytes.size() < header_size)
+            throw std::runtime_error("Truncated packed weights");
+        std::memcpy(&header, bytes.data(), header_size);
+        const std::size_t id_count = (bytes.size() - header_size) / sizeof(std::uint64_t);
+        if (header.pattern_count > id_count || header.scalar_feature_count > id_count - header.pattern_count)
+            throw std::runtime_error("Truncated packed weights");
+        std::vector<BitBoard> masks(header.pattern_count);
+        std::memcpy(masks.data(), bytes.data() + header_size, masks.size() * sizeof(BitBoard));
+        std::vector<ScalarFeature> features(header.scalar_feature_count);
+        for (std::size_t i = 0; i < features.size(); i++)
+        {
+            std::uint64_t id; // NOLINT(cppcoreguidelines-init-variables)
+            std::memcpy(&id, bytes.data() + header_size + (masks.size() + i) * sizeof(std::uint64_t), sizeof(id));
+            features[i] = to_scalar_feature(id);
+        }
+
+        auto res = std::unique_ptr<LinearPatternEvaluator>(new LinearPatternEvaluator);
+        res->load_packed_layout(header.stages, masks, features, header.stage_weight_size, header.stage_table_size);
+        // The weights point into the mapping, and keep it alive
+        const auto view = [&](const std::uint64_t offset, const std::size_t size)
+        {
+            if (offset > bytes.size() || size > (bytes.size() - offset) / sizeof(float))
+                throw std::runtime_error("Truncated packed weights");
+            return std::shared_ptr<const float>(file, reinterpret_cast<const float*>(bytes.data() + offset));
+        };
+        res->weights_ = view(header.weights_offset, res->stages_ * res->stage_weight_size_);
+        res->weights_writable_ = false;
+        res->expanded_weights_ = view(header.expanded_offset, res->stages_ * res->stage_table_size_);
+        return res;
     }
 
     void LinearPatternEvaluator::save(std::ostream& stream) const
     {
         write(stream, stages_);
-        for (const auto& p : patterns_)
-            p.save(stream);
-        write(stream, BitBoard{});
+        for (const auto& pattern : patterns_)
+        {
+            write(stream, pattern.pattern);
+            for (std::size_t stage = 0; stage < stages_; stage++)
+            {
+                const auto weights = weights_at_stage(pattern, stage);
+                stream.write(reinterpret_cast<const char*>(weights.data()),
+                    static_cast<std::streamsize>(sizeof(float) * weights.size()));
+            }
+        }
+        // Files without scalar features stay readable by the versions before them
+        if (scalar_features_.empty())
+        {
+            write(stream, BitBoard{});
+            return;
+        }
+        write(stream, scalar_features_marker);
+        write(stream, static_cast<std::uint64_t>(scalar_features_.size()));
+        for (const auto feature : scalar_features_)
+            write(stream, static_cast<std::uint64_t>(feature));
+        for (std::size_t stage = 0; stage < stages_; stage++)
+        {
+            const auto weights = scalar_weights_at_stage(stage);
+            stream.write(reinterpret_cast<const char*>(weights.data()),
+                static_cast<std::streamsize>(sizeof(float) * weights.size()));
+        }
     }
 
-    LinearPatternEvaluator::Pattern::Pattern(const BitBoard mask, const std::size_t stages):
-        pattern(find_pattern_canonical_form(mask)), symmetry(find_pattern_symmetry(pattern)),
-        index_map(generate_pattern_index_map(pattern, symmetry)), count(std::ranges::max(index_map) + 1),
-        weights(stages * count)
+    void LinearPatternEvaluator::save_packed(std::ostream& stream) const
     {
+        const auto align = [](const std::uint64_t offset)
+        { return (offset + cache_line_size - 1) / cache_line_size * cache_line_size; };
+        const std::size_t weight_count = stages_ * stage_weight_size_;
+        const std::size_t expanded_count = stages_ * stage_table_size_;
+        const std::uint64_t ids_end =
+            sizeof(PackedHeader) + (patterns_.size() + scalar_features_.size()) * sizeof(std::uint64_t);
+        const std::uint64_t weights_offset = align(ids_end);
+        const PackedHeader header{
+            .magic = packed_magic,
+            .version = packed_version,
+            .stages = stages_,
+            .pattern_count = patterns_.size(),
+            .stage_weight_size = stage_weight_size_,
+            .stage_table_size = stage_table_size_,
+            .weights_offset = weights_offset,
+            .expanded_offset = align(weights_offset + weight_count * sizeof(float)),
+            .scalar_feature_count = scalar_features_.size(),
+        };
+
+        write(stream, header);
+        for (const auto& pattern : patterns_)
+            write(stream, pattern.pattern);
+        for (const auto feature : scalar_features_)
+            write(stream, static_cast<std::uint64_t>(feature));
+        std::uint64_t position = ids_end;
+        const auto write_floats = [&](const std::uint64_t offset, const float* data, const std::size_t size)
+        {
+            for (; position < offset; position++)
+                stream.put('\0');
+            stream.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(size * sizeof(float)));
+            position += size * sizeof(float);
+        };
+        write_floats(header.weights_offset, weights_.get(), weight_count);
+        write_floats(header.expanded_offset, expanded_weights_.get(), expanded_count);
     }
 
-    LinearPatternEvaluator::Pattern LinearPatternEvaluator::Pattern::load(
-        std::istream& stream, const std::size_t stages)
+    void LinearPatternEvaluator::save_packed(const std::filesystem::path& path) const
     {
-        Pattern res(read<BitBoard>(stream), stages);
-        stream.read(reinterpret_cast<char*>(res.weights.data()),
-            static_cast<std::streamsize>(sizeof(float) * res.weights.size()));
-        return res;
+        std::ofstream stream(path, std::ios::binary);
+        save_packed(stream);
     }
 
-    void LinearPatternEvaluator::Pattern::save(std::ostream& stream) const
+    LinearPatternEvaluator::Pattern::Pattern(const BitBoard mask):
+        pattern(find_pattern_canonical_form(mask)), symmetry(find_pattern_symmetry(pattern)),
+        extractor(pattern), index_map(cached_pattern_index_map(pattern, symmetry)),
+        count(std::ranges::max(*index_map) + 1)
     {
-        write(stream, pattern);
-        stream.write(reinterpret_cast<const char*>(weights.data()),
-            static_cast<std::streamsize>(sizeof(float) * weights.size()));
     }
 
-    std::span<float> LinearPatternEvaluator::Pattern::weights_at_stage(const std::size_t stage) noexcept
+    std::size_t LinearPatternEvaluator::stage_of(const Board& board) const noexcept
     {
-        return {weights.data() + stage * count, count};
+        return flr::stage_of(board, stages_);
     }
 
-    std::span<const float> LinearPatternEvaluator::Pattern::weights_at_stage(const std::size_t stage) const noexcept
+    std::span<const float> LinearPatternEvaluator::weights_at_stage(
+        const Pattern& pattern, const std::size_t stage) const noexcept
     {
-        return {weights.data() + stage * count, count};
+        return {weights_.get() + stage * stage_weight_size_ + pattern.offset, pattern.count};
     }
 
-    std::span<float> LinearPatternEvaluator::Pattern::gradients_at_stage(const std::size_t stage) noexcept
+    std::span<const float> LinearPatternEvaluator::scalar_weights_at_stage(const std::size_t stage) const noexcept
     {
-        return {gradients.data() + stage * count, count};
+        return {weights_.get() + stage * stage_weight_size_ + scalar_weight_offset_, scalar_features_.size()};
     }
 
-    void LinearPatternEvaluator::Pattern::apply_gradients() noexcept
+    float* LinearPatternEvaluator::mutable_weights()
     {
-        assert(gradients.size() == weights.size());
-        const std::size_t size = weights.size();
-        for (std::size_t i = 0; i < size; i++)
-            weights[i] -= gradients[i];
+        // Copy on write, the arena may be shared with clones or mapped from a read-only file
+        if (!weights_writable_ || weights_.use_count() > 1)
+        {
+            const float* weights = weights_.get();
+            weights_ = share(CacheAlignedVector<float>(weights, weights + stages_ * stage_weight_size_));
+            weights_writable_ = true;
+        }
+        return const_cast<float*>(weights_.get());
     }
 
-    void LinearPatternEvaluator::Pattern::reset_gradients()
+    void LinearPatternEvaluator::assign_weight_offsets()
     {
-        if (gradients.empty())
+        std::size_t offset = 0;
+        for (auto& pattern : patterns_)
         {
-            gradients.resize(weights.size());
+            pattern.offset = offset;
+            offset += pattern.count;
+        }
+        scalar_weight_offset_ = offset;
+        stage_weight_size_ = round_up_to_cache_lines<float>(offset + scalar_features_.size());
+    }
+
+    void LinearPatternEvaluator::layout_weights(const std::size_t old_scalar_count)
+    {
+        // Patterns and scalar features are only ever appended, so the existing patterns keep their offsets in a
+        // stage, and the existing scalar features are moved after the new patterns
+        const std::size_t old_stage_size = stage_weight_size_;
+        const std::size_t old_scalar_offset = scalar_weight_offset_;
+        assign_weight_offsets();
+        if (stage_weight_size_ == old_stage_size && scalar_weight_offset_ == old_scalar_offset && weights_)
             return;
+        CacheAlignedVector<float> weights(stages_ * stage_weight_size_);
+        if (old_stage_size != 0)
+        {
+            for (std::size_t stage = 0; stage < stages_; stage++)
+            {
+                const float* old_weights = weights_.get() + stage * old_stage_size;
+                float* new_weights = weights.data() + stage * stage_weight_size_;
+                std::copy_n(old_weights, old_scalar_offset, new_weights);
+                std::copy_n(old_weights + old_scalar_offset, old_scalar_count, new_weights + scalar_weight_offset_);
+            }
         }
-        assert(gradients.size() == weights.size());
-        std::ranges::fill(gradients, 0.0f);
+        weights_ = share(std::move(weights));
+        weights_writable_ = true;
+        gradients_.clear();
+        reset_optimizer_state();
     }
 
-    std::size_t LinearPatternEvaluator::stage_of(const Board& board) const noexcept
+    void LinearPatternEvaluator::load_packed_layout(const std::size_t stages, const std::span<const BitBoard> patterns,
+        const std::span<const ScalarFeature> scalar_features, const std::size_t stage_weight_size,
+        const std::size_t stage_table_size)
+    {
+        if (stages == 0)
+            throw std::runtime_error("Packed weights without stages");
+        stages_ = stages;
+        patterns_.reserve(patterns.size());
+        for (const auto pattern : patterns)
+            patterns_.emplace_back(pattern);
+        scalar_features_.assign(scalar_features.begin(), scalar_features.end());
+        assign_weight_offsets();
+        build_instance_tables();
+        if (stage_weight_size_ != stage_weight_size || stage_table_size_ != stage_table_size)
+            throw std::runtime_error("The layout of the packed weights does not match their patterns");
+    }
+
+    void LinearPatternEvaluator::build_instance_tables()
     {
-        return static_cast<std::size_t>(board.count_total() - 4) * stages_ / (cell_count - 4);
+        stage_table_size_ = round_up_to_cache_lines<float>(build_instance_offsets(patterns_, instance_offsets_));
+        padded_instance_count_ = instance_offsets_.size();
+        feature_size_ = padded_instance_count_ * 2;
+        build_feature_deltas(patterns_, padded_instance_count_, black_deltas_, white_deltas_);
     }
+
+    void LinearPatternEvaluator::expand_weights()
+    {
+        CacheAlignedVector<float> expanded(stages_ * stage_table_size_);
+        for (std::size_t stage = 0; stage < stages_; stage++)
+        {
+            float* table = expanded.data() + stage * stage_table_size_ + 1;
+            for (const auto& pattern : patterns_)
+            {
+                const auto weights = weights_at_stage(pattern, stage);
+                for (const auto mapped : *pattern.index_map)
+                    *table++ = weights[mapped];
+            }
+        }
+        expanded_weights_ = share(std::move(expanded));
+    }
+
+    // Instantiated here so that evaluate can be inlined into the search
+    template class FLUORINE_API BasicMidgameSearcher<LinearPatternEvaluator>;
 } // namespace flr
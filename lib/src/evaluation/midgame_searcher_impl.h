@@ -0,0 +1,842 @@
+#pragma once
+
+#include <cmath>
+#include <array>
+#include <thread>
+#include <clu/static_vector.h>
+
+#include "fluorine/evaluation/midgame_searcher.h"
+#include "iterate_moves.h"
+#include "../core/flip.h"
+#include "fluorine/utils/bit.h"
+
+// Implementation of BasicMidgameSearcher, only included by the translation units that explicitly instantiate it.
+// Each specialization is instantiated in exactly one of them.
+
+namespace flr
+{
+    namespace
+    {
+        constexpr int min_negascout_depth = 4;
+        constexpr int min_shallow_search_required_depth = 10;
+        constexpr std::size_t leaf_batch_size = 4; // Leaves evaluated together at frontier nodes
+
+        // Move ordering parameters
+        constexpr std::size_t max_ply = 2 * cell_count; // Passes don't consume depth
+        constexpr std::size_t history_stages = 8;
+        constexpr int max_history = 1 << 14;
+        constexpr int mobility_weight = 1 << 11; // One opponent move is worth this much history
+
+        // Iterative deepening parameters
+        constexpr int aspiration_window = 2 * score_scale;
+        constexpr int unstable_score_change = score_scale;
+        constexpr std::size_t nodes_between_polls = 4096;
+        constexpr double default_branching_factor = 4.0;
+        constexpr double min_branching_factor = 1.5;
+        constexpr double max_branching_factor = 10.0;
+
+        using Clock = std::chrono::steady_clock;
+
+        using Line = clu::static_vector<Coords, max_ply>;
+
+        // Evaluators that can keep their features up to date as moves are played, instead of starting from the board
+        template <typename EvaluatorT>
+        concept incremental_evaluator = requires { typename EvaluatorT::FeatureState; };
+
+        struct NoFeatures
+        {
+        };
+
+        template <typename EvaluatorT>
+        struct FeaturesOf
+        {
+            using type = NoFeatures;
+        };
+
+        template <incremental_evaluator EvaluatorT>
+        struct FeaturesOf<EvaluatorT>
+        {
+            using type = typename EvaluatorT::FeatureState;
+        };
+    } // namespace
+
+    // Search state of a single thread
+    template <typename EvaluatorT>
+    class BasicMidgameSearcher<EvaluatorT>::Worker final
+    {
+    public:
+        struct RootMove final
+        {
+            Coords move;
+            int score;
+            Line pv;
+        };
+
+        using RootMoves = clu::static_vector<RootMove, cell_count>;
+
+        explicit Worker(BasicMidgameSearcher& searcher, const bool is_helper) noexcept:
+            searcher_(&searcher), is_helper_(is_helper)
+        {
+        }
+
+        void start(const GameState& state, const EvaluatorT& evaluator)
+        {
+            for (auto& killers : killers_)
+                killers.fill(Coords::none);
+            // Age the history instead of clearing it, consecutive searches tend to have similar good moves
+            for (auto& stage : history_)
+                for (int& value : stage)
+                    value /= 2;
+            ply_offset_ = 0;
+            nodes_ = 0;
+            eval_ = &evaluator;
+            record_.reset(state);
+            if constexpr (incremental_evaluator<EvaluatorT>)
+                features_ = eval_->features_of(state.board);
+            deadline_.reset();
+            next_poll_ = 0;
+            aborted_ = false;
+        }
+
+        void set_deadline(const Clock::time_point deadline) noexcept { deadline_ = deadline; }
+        [[nodiscard]] std::size_t nodes() const noexcept { return nodes_; }
+        [[nodiscard]] bool aborted() const noexcept { return aborted_; }
+
+        RootMoves root_moves(const GameState& state, const int depth)
+        {
+            RootMoves moves;
+            if (state.legal_moves == 0)
+                moves.push_back({Coords::none, -fixed_inf, {}});
+            else
+            {
+                const auto sorted_moves = depth >= min_shallow_search_required_depth //
+                    ? sort_moves(state, -fixed_inf, fixed_inf, depth / 2)
+                    : sort_moves_wrt_mobility(state);
+                for (const Coords move : sorted_moves)
+                    moves.push_back({move, -fixed_inf, {}});
+            }
+            return moves;
+        }
+
+        // With pv_count > 1, the moves are sorted by their scores after the search, and the scores of the first
+        // pv_count moves are exact if they are inside the window. Otherwise only the best move is moved to the front.
+        int search_root(const std::span<RootMove> moves, const int alpha, const int beta, const int depth,
+            const std::size_t pv_count = 1)
+        {
+            int best = -fixed_inf;
+            std::size_t best_index = 0;
+            clu::static_vector<int, cell_count> top_scores; // Sorted in descending order
+            for (std::size_t i = 0; i < moves.size(); i++)
+            {
+                auto& [move, score, pv] = moves[i];
+                const bool pass = move == Coords::none;
+                const int lower = std::max(alpha, top_scores.size() >= pv_count ? top_scores[pv_count - 1] : -fixed_inf);
+                play(move);
+                score = -negascout(-beta, -lower, pass ? depth : depth - 1, pass, true);
+                undo();
+                if (aborted_)
+                    return best;
+                pv = score > lower && score < beta ? line_after(move) : Line{move};
+                top_scores.insert(std::ranges::upper_bound(top_scores, score, std::greater{}), score);
+                if (score > best)
+                {
+                    best = score;
+                    best_index = i;
+                }
+                if (top_scores.size() >= pv_count && top_scores[pv_count - 1] >= beta)
+                    break;
+            }
+            if (pv_count > 1)
+                std::ranges::stable_sort(moves, std::greater{}, &RootMove::score);
+            else // Move the best move to the front, keeping the order of the rest
+                std::rotate(moves.begin(), moves.begin() + static_cast<std::ptrdiff_t>(best_index),
+                    moves.begin() + static_cast<std::ptrdiff_t>(best_index) + 1);
+            return best;
+        }
+
+        // Lazy SMP helper, deepens iteratively with a perturbed root move order until the main thread is done
+        void help(const GameState& state, const int max_depth, const std::size_t index)
+        {
+            auto moves = root_moves(state, 1);
+            std::rotate(moves.begin(), moves.begin() + static_cast<std::ptrdiff_t>(index % moves.size()), moves.end());
+            // Half of the helpers search one ply deeper than the main thread
+            const int depth_offset = static_cast<int>(index % 2);
+            for (int depth = 1 + depth_offset; depth <= max_depth + depth_offset; depth++)
+            {
+                search_root(moves, -fixed_inf, fixed_inf, depth);
+                if (aborted_)
+                    return;
+            }
+        }
+
+        int negascout(int alpha, int beta, const int depth, const bool passed, const bool needs_shallow)
+        {
+            if (depth < min_negascout_depth)
+                return negamax(alpha, beta, depth, passed);
+            pv_[ply()].clear();
+            if (should_abort())
+                return 0;
+            nodes_++;
+            auto& tt = searcher_->tt_;
+            const GameState state = record_.current_canonical();
+            const std::size_t hash = tt.hash(state.board);
+            Bounds<FixedScore> bounds;
+            const int original_beta = beta;
+            if (const auto entry = tt.try_load(state.board, depth, hash))
+            {
+                bounds = *entry;
+                if (bounds.upper <= alpha) // alpha-cut
+                    return bounds.upper;
+                if (bounds.lower >= beta) // beta-cut
+                    return bounds.lower;
+                if (bounds.upper == bounds.lower) // Got the exact value
+                    return bounds.lower;
+                alpha = std::max<int>(alpha, bounds.lower);
+                beta = std::min<int>(beta, bounds.upper);
+            }
+            if (const auto& params = searcher_->probcut_; params && state.legal_moves != 0 &&
+                depth >= params->min_depth() && depth <= params->max_depth())
+            {
+                if (const auto cut = probcut(state.board, alpha, beta, depth, passed))
+                    return *cut;
+                if (aborted_)
+                    return 0;
+                pv_[ply()].clear(); // Written by the shallow searches
+            }
+            int score = -fixed_inf;
+            const BitBoard moves = state.legal_moves;
+            const auto store = [&](const int lower, const int upper)
+            { tt.store(state.board, depth, {static_cast<FixedScore>(lower), static_cast<FixedScore>(upper)}, hash); };
+            const auto add_tt_entry = [&]
+            {
+                if (score <= alpha)
+                    store(bounds.lower, score);
+                else if (score >= beta)
+                    store(score, bounds.upper);
+                else
+                    store(score, score);
+            };
+            if (moves == 0) // Pass
+            {
+                if (passed)
+                {
+                    score = state.final_score() * score_scale;
+                    store(score, score);
+                    return score;
+                }
+                play(Coords::none);
+                score = -negascout(-beta, -alpha, depth, true, needs_shallow);
+                undo();
+                if (aborted_)
+                    return 0;
+                if (score > alpha && score < beta)
+                    update_pv(Coords::none);
+                add_tt_entry();
+                return score;
+            }
+            MoveVec searched;
+            // Returns true if the remaining moves need not be searched
+            const auto search_move = [&](const Coords move)
+            {
+                play(move);
+                const int lower = std::max(alpha, score);
+                int new_score;
+                if (lower == -fixed_inf)
+                    new_score = -negascout(-beta, fixed_inf, depth - 1, false, needs_shallow);
+                else
+                {
+                    // Search with a null window
+                    new_score = -negascout(-lower - 1, -lower, depth - 1, false, needs_shallow);
+                    if (lower < new_score && new_score < beta) // Re-search
+                        new_score = -negascout(-beta, -lower, depth - 1, false, needs_shallow);
+                }
+                undo();
+                if (new_score > score)
+                {
+                    score = new_score;
+                    if (score >= beta) // beta-cut
+                    {
+                        if (!aborted_)
+                            update_ordering(state.board, move, depth, searched);
+                        // The window might have been narrowed by the table, the score can still be exact for the parent
+                        if (score < original_beta)
+                            update_pv(move);
+                        return true;
+                    }
+                    if (score > alpha)
+                        update_pv(move);
+                }
+                searched.push_back(move);
+                return aborted_;
+            };
+            if (needs_shallow && depth >= min_shallow_search_required_depth)
+            {
+                for (const Coords move : sort_moves(state, alpha, beta, depth / 2))
+                    if (search_move(move))
+                        break;
+            }
+            else
+            {
+                // Try the killer moves before paying for ordering the rest
+                BitBoard remaining = moves;
+                bool cut = false;
+                for (const Coords killer : killers_[ply()])
+                {
+                    if (killer == Coords::none || (remaining & bit_of(killer)) == 0)
+                        continue;
+                    remaining &= ~bit_of(killer);
+                    if ((cut = search_move(killer)))
+                        break;
+                }
+                if (!cut)
+                    for (const Coords move : order_moves(state, remaining))
+                        if (search_move(move))
+                            break;
+            }
+            if (aborted_) // Do not pollute the table with partial results
+                return 0;
+            add_tt_entry();
+            return score;
+        }
+
+    private:
+        BasicMidgameSearcher* searcher_;
+        bool is_helper_;
+        std::size_t nodes_ = 0;
+        GameRecord record_;
+        GameRecord temp_record_;
+        [[no_unique_address]] typename FeaturesOf<EvaluatorT>::type features_; // Follows record_.current()
+        [[no_unique_address]] typename FeaturesOf<EvaluatorT>::type leaf_features_; // Scratch for frontier nodes
+        std::size_t ply_offset_ = 0; // Ply of the root of record_, non-zero in shallow searches for sorting
+        std::array<std::array<Coords, 2>, max_ply> killers_{};
+        std::array<std::array<int, cell_count>, history_stages> history_{};
+        std::array<Line, max_ply + 1> pv_{}; // Triangular PV table, pv_[ply] is the line from the node at that ply
+        const EvaluatorT* eval_ = nullptr; // Calls are resolved statically if EvaluatorT is final
+        std::optional<Clock::time_point> deadline_;
+        std::size_t next_poll_ = 0;
+        bool aborted_ = false;
+
+        void play(const Coords move)
+        {
+            record_.play(move);
+            if constexpr (incremental_evaluator<EvaluatorT>)
+                if (move != Coords::none)
+                    eval_->update_features(features_, record_.states().end()[-2].board, record_.current().board);
+        }
+
+        void undo()
+        {
+            if constexpr (incremental_evaluator<EvaluatorT>)
+            {
+                const Board board = record_.current().board;
+                record_.undo();
+                eval_->update_features(features_, board, record_.current().board);
+            }
+            else
+                record_.undo();
+        }
+
+        // Replace the current position, keeping the features in sync
+        void reset(const GameState& state)
+        {
+            if constexpr (incremental_evaluator<EvaluatorT>)
+                eval_->update_features(features_, record_.current().board, state.board);
+            record_.reset(state);
+        }
+
+        int evaluate_leaf(const GameState& canonical_state) const
+        {
+            if constexpr (incremental_evaluator<EvaluatorT>)
+                return eval_->evaluate_fixed(record_.current(), features_);
+            else
+                return eval_->evaluate_fixed(canonical_state.board);
+        }
+
+        bool should_abort()
+        {
+            if (aborted_)
+                return true;
+            if (is_helper_ && searcher_->stop_helpers_.load(std::memory_order_relaxed))
+                return aborted_ = true;
+            if (deadline_ && nodes_ >= next_poll_)
+            {
+                next_poll_ = nodes_ + nodes_between_polls;
+                aborted_ = Clock::now() >= *deadline_;
+            }
+            return aborted_;
+        }
+
+        // Frontier node whose children are all leaves. The first child, most likely the killer move, is evaluated
+        // alone since it often causes a beta-cut by itself. The others are evaluated in batches so that the
+        // evaluator can work on several boards at once, and the last few one by one.
+        int evaluate_children(const GameState& state, const BitBoard moves, int alpha, const int beta)
+        {
+            const MoveVec ordered = killers_first(moves);
+            std::size_t begin = 0;
+            std::optional<int> cut;
+            const auto visit = [&](const Coords move, const int score)
+            {
+                if (score >= beta)
+                    cut = score;
+                else if (score > alpha)
+                {
+                    alpha = score;
+                    pv_[ply()] = Line{move};
+                }
+                return cut.has_value();
+            };
+            if constexpr (incremental_evaluator<EvaluatorT>)
+            {
+                // Updating the features for each child is cheaper than extracting them from the boards.
+                // The legal moves of the children are not needed, so only the flips are computed. The children are
+                // evaluated one by one, batching them costs more in the evaluations after a beta-cut than it saves.
+                const GameState& current = record_.current();
+                for (const Coords move : ordered)
+                {
+                    nodes_++;
+                    const BitBoard flips = find_flips(static_cast<int>(move), state.board.black, state.board.white);
+                    GameState child = current;
+                    BitBoard& self = current.current == Color::black ? child.board.black : child.board.white;
+                    BitBoard& opponent = current.current == Color::black ? child.board.white : child.board.black;
+                    self |= flips;
+                    opponent &= ~flips;
+                    child.current = opponent_of(current.current);
+                    // Copying the features is cheaper than undoing the update
+                    leaf_features_ = features_;
+                    eval_->update_features(leaf_features_, current.board, child.board);
+                    const int score = -eval_->evaluate_fixed(child, leaf_features_);
+                    if (visit(move, score))
+                        return *cut;
+                }
+                return alpha;
+            }
+            const auto evaluate_single = [&](const Coords move)
+            {
+                nodes_++;
+                return visit(move, -eval_->evaluate_fixed(state.play_copied(move).canonical_board()));
+            };
+
+            if (evaluate_single(ordered[begin++]))
+                return *cut;
+            for (; begin + leaf_batch_size <= ordered.size(); begin += leaf_batch_size)
+            {
+                std::array<Board, leaf_batch_size> children; // NOLINT(cppcoreguidelines-pro-type-member-init)
+                std::array<float, leaf_batch_size> scores; // NOLINT(cppcoreguidelines-pro-type-member-init)
+                for (std::size_t i = 0; i < leaf_batch_size; i++)
+                    children[i] = state.play_copied(ordered[begin + i]).canonical_board();
+                eval_->evaluate_batch(children, scores);
+                nodes_ += leaf_batch_size;
+                for (std::size_t i = 0; i < leaf_batch_size; i++)
+                    if (visit(ordered[begin + i], -to_fixed_score(scores[i])))
+                        return *cut;
+            }
+            for (; begin < ordered.size(); begin++)
+                if (evaluate_single(ordered[begin]))
+                    return *cut;
+            return alpha;
+        }
+
+        int negamax(int alpha, const int beta, const int depth, const bool passed)
+        {
+            nodes_++;
+            pv_[ply()].clear();
+            const GameState state = record_.current_canonical();
+            if (depth == 0)
+                return evaluate_leaf(state);
+            const BitBoard moves = state.legal_moves;
+            if (moves == 0)
+            {
+                if (passed)
+                    return state.final_score() * score_scale;
+                play(Coords::none);
+                const int score = -negamax(-beta, -alpha, depth, true);
+                undo();
+                if (score > alpha && score < beta)
+                    update_pv(Coords::none);
+                return score;
+            }
+            if (depth == 1)
+                return evaluate_children(state, moves, alpha, beta);
+            for (const Coords move : killers_first(moves))
+            {
+                play(move);
+                const int score = -negamax(-beta, -alpha, depth - 1, false);
+                undo();
+                if (score > alpha)
+                {
+                    if (score >= beta)
+                    {
+                        if (depth > 1)
+                            update_ordering(state.board, move, depth, {});
+                        return score;
+                    }
+                    alpha = score;
+                    update_pv(move);
+                }
+            }
+            return alpha;
+        }
+
+        [[nodiscard]] std::size_t ply() const noexcept
+        {
+            return std::min(record_.states().size() - 1 + ply_offset_, max_ply - 1);
+        }
+
+        // Killer moves first, then the rest in an arbitrary order since sorting costs more than it saves near the leaves
+        [[nodiscard]] MoveVec killers_first(const BitBoard moves) const
+        {
+            MoveVec ordered;
+            BitBoard remaining = moves;
+            for (const Coords killer : killers_[ply()])
+                if (killer != Coords::none && (remaining & bit_of(killer)))
+                {
+                    ordered.push_back(killer);
+                    remaining &= ~bit_of(killer);
+                }
+            for (const auto move : SetBits{remaining})
+                ordered.push_back(static_cast<Coords>(move));
+            return ordered;
+        }
+
+        // The given move followed by the PV of the child node
+        [[nodiscard]] Line line_after(const Coords move) const
+        {
+            Line line{move};
+            for (const Coords next : pv_[ply() + 1])
+                line.push_back(next);
+            return line;
+        }
+
+        void update_pv(const Coords move) { pv_[ply()] = line_after(move); }
+
+        [[nodiscard]] static std::size_t history_stage_of(const Board& board) noexcept
+        {
+            return static_cast<std::size_t>(board.count_total() - 4) * history_stages / (cell_count - 3);
+        }
+
+        // Reward the move that caused a beta-cut, and penalize the ones that were searched before it
+        void update_ordering(const Board& board, const Coords move, const int depth, const std::span<const Coords> searched)
+        {
+            auto& killers = killers_[ply()];
+            if (killers[0] != move)
+            {
+                killers[1] = killers[0];
+                killers[0] = move;
+            }
+            auto& history = history_[history_stage_of(board)];
+            const int bonus = std::min(depth * depth, max_history);
+            // Scaled by the distance to the limit so that the values stay within [-max_history, max_history]
+            const auto update = [&](int& value, const int delta) { value += delta - value * bonus / max_history; };
+            update(history[static_cast<std::size_t>(move)], bonus);
+            for (const Coords other : searched)
+                update(history[static_cast<std::size_t>(other)], -bonus);
+        }
+
+        // Cheap ordering, combining the history score with the opponent's mobility after the move
+        MoveVec order_moves(const GameState& state, const BitBoard moves) const
+        {
+            const auto& history = history_[history_stage_of(state.board)];
+            clu::static_vector<std::pair<Coords, int>, cell_count> weighted_moves;
+            for (const int bit : SetBits{moves})
+            {
+                const auto move = static_cast<Coords>(bit);
+                const int mobility = std::popcount(state.play_copied(move).legal_moves);
+                weighted_moves.emplace_back(move, history[static_cast<std::size_t>(bit)] - mobility * mobility_weight);
+            }
+            std::ranges::sort(weighted_moves, std::greater{}, &std::pair<Coords, int>::second);
+            MoveVec res;
+            for (const auto move : weighted_moves | std::views::keys)
+                res.push_back(move);
+            return res;
+        }
+
+        std::optional<int> probcut(const Board& board, const int alpha, const int beta, const int depth, const bool passed)
+        {
+            const auto& params = *searcher_->probcut_;
+            const std::size_t stage = params.stage_of(board);
+            // The cheapest check goes first, the deeper ones are only paid for when it does not cut
+            for (std::size_t check = params.checks(); check-- > 0;)
+            {
+                const int shallow_depth = ProbCutParameters::shallow_depth(depth, check);
+                if (shallow_depth < 0)
+                    continue;
+                if (const auto cut = probcut_check(params.regression(stage, depth, check), alpha, beta, shallow_depth,
+                        passed))
+                    return cut;
+                if (aborted_)
+                    return std::nullopt;
+            }
+            return std::nullopt;
+        }
+
+        std::optional<int> probcut_check(const ProbCutParameters::Regression& regression, const int alpha,
+            const int beta, const int shallow_depth, const bool passed)
+        {
+            const auto [slope, intercept, sigma] = regression;
+            if (sigma == inf) // Not calibrated
+                return std::nullopt;
+            // The regression is in disks
+            constexpr auto scale = static_cast<float>(score_scale);
+            const float margin = searcher_->probcut_threshold_ * sigma * scale;
+            // Shallow score that predicts the given deep score
+            const auto shallow_bound = [&](const float deep)
+            {
+                const float bound = (deep - intercept * scale) / slope;
+                return std::clamp(bound, static_cast<float>(-fixed_inf), static_cast<float>(fixed_inf));
+            };
+            // Cut if the shallow search predicts that the deep search would fail high or low with high probability
+            if (beta < fixed_inf)
+            {
+                const int bound = static_cast<int>(std::ceil(shallow_bound(static_cast<float>(beta) + margin)));
+                if (bound < fixed_inf && negascout(bound - 1, bound, shallow_depth, passed, false) >= bound)
+                    return beta;
+            }
+            if (alpha > -fixed_inf)
+            {
+                const int bound = static_cast<int>(std::floor(shallow_bound(static_cast<float>(alpha) - margin)));
+                if (bound > -fixed_inf && negascout(bound, bound + 1, shallow_depth, passed, false) <= bound)
+                    return alpha;
+            }
+            return std::nullopt;
+        }
+
+        clu::static_vector<Coords, cell_count> sort_moves(
+            const GameState& state, const int alpha, const int beta, const int depth)
+        {
+            if (std::has_single_bit(state.legal_moves))
+                return {static_cast<Coords>(std::countr_zero(state.legal_moves))};
+            clu::static_vector<std::pair<Coords, int>, cell_count> weighted_moves;
+            const std::size_t old_ply_offset = std::exchange(ply_offset_, ply() + 1);
+            const GameState current = record_.current();
+            std::swap(record_, temp_record_);
+            record_.reset(current); // Where the features are at
+            for (const int bit : SetBits{state.legal_moves})
+            {
+                GameState s = state;
+                const auto move = static_cast<Coords>(bit);
+                s.play(move);
+                reset(s);
+                const int weight = -negascout(-beta, -alpha, depth, false, false);
+                weighted_moves.emplace_back(move, weight);
+            }
+            reset(current);
+            std::swap(record_, temp_record_);
+            ply_offset_ = old_ply_offset;
+            std::ranges::sort(weighted_moves, std::greater{}, &std::pair<Coords, int>::second);
+            clu::static_vector<Coords, cell_count> res;
+            for (const auto move : weighted_moves | std::views::keys)
+                res.emplace_back(static_cast<Coords>(move));
+            return res;
+        }
+    };
+
+    template <typename EvaluatorT>
+    template <typename F>
+    auto BasicMidgameSearcher<EvaluatorT>::run_workers(
+        const GameState& state, const EvaluatorT& evaluator, const int helper_depth, F&& main_search)
+    {
+        tt_.clear();
+        stop_helpers_.store(false, std::memory_order_relaxed);
+        for (const auto& worker : workers_)
+            worker->start(state, evaluator);
+        if (!helper_threads_.empty())
+        {
+            {
+                std::scoped_lock lock(helper_mutex_);
+                helper_state_ = state;
+                helper_depth_ = helper_depth;
+                busy_helpers_ = helper_threads_.size();
+                search_generation_++;
+            }
+            helpers_wake_.notify_all();
+        }
+        auto res = std::forward<F>(main_search)(*workers_[0]);
+        stop_helpers_.store(true, std::memory_order_relaxed);
+        {
+            std::unique_lock lock(helper_mutex_);
+            helpers_done_.wait(lock, [&] { return busy_helpers_ == 0; });
+        }
+        res.traversed_nodes = 0;
+        for (const auto& worker : workers_)
+            res.traversed_nodes += worker->nodes();
+        return res;
+    }
+
+    template <typename EvaluatorT>
+    BasicMidgameSearcher<EvaluatorT>::BasicMidgameSearcher()
+    {
+        set_thread_count(1);
+    }
+
+    template <typename EvaluatorT>
+    BasicMidgameSearcher<EvaluatorT>::~BasicMidgameSearcher() noexcept
+    {
+        stop_helper_threads();
+    }
+
+    template <typename EvaluatorT>
+    void BasicMidgameSearcher<EvaluatorT>::helper_loop(const std::size_t index, std::uint64_t generation)
+    {
+        std::unique_lock lock(helper_mutex_);
+        while (true)
+        {
+            helpers_wake_.wait(lock, [&] { return shutting_down_ || search_generation_ != generation; });
+            if (shutting_down_)
+                return;
+            generation = search_generation_;
+            const GameState state = helper_state_;
+            const int depth = helper_depth_;
+            lock.unlock();
+            workers_[index]->help(state, depth, index);
+            lock.lock();
+            if (--busy_helpers_ == 0)
+                helpers_done_.notify_one();
+        }
+    }
+
+    template <typename EvaluatorT>
+    void BasicMidgameSearcher<EvaluatorT>::stop_helper_threads() noexcept
+    {
+        {
+            std::scoped_lock lock(helper_mutex_);
+            shutting_down_ = true;
+        }
+        helpers_wake_.notify_all();
+        for (auto& thread : helper_threads_)
+            thread.join();
+        helper_threads_.clear();
+        shutting_down_ = false;
+    }
+
+    template <typename EvaluatorT>
+    auto BasicMidgameSearcher<EvaluatorT>::evaluate( //
+        const GameState& state, const EvaluatorT& evaluator, const int depth) -> EvalResult
+    {
+        return run_workers(state, evaluator, depth,
+            [&](Worker& main) -> EvalResult
+            { return {.score = from_fixed_score(main.negascout(-fixed_inf, fixed_inf, depth, false, true))}; });
+    }
+
+    template <typename EvaluatorT>
+    auto BasicMidgameSearcher<EvaluatorT>::search( //
+        const GameState& state, const EvaluatorT& evaluator, const int depth) -> SolveResult
+    {
+        return run_workers(state, evaluator, depth,
+            [&](Worker& main) -> SolveResult
+            {
+                auto moves = main.root_moves(state, depth);
+                const int score = main.search_root(moves, -fixed_inf, fixed_inf, depth);
+                const auto& pv = moves.front().pv;
+                return {.score = from_fixed_score(score),
+                    .move = moves.front().move,
+                    .depth = depth,
+                    .pv = {pv.begin(), pv.end()}};
+            });
+    }
+
+    template <typename EvaluatorT>
+    auto BasicMidgameSearcher<EvaluatorT>::search_multi_pv(const GameState& state, const EvaluatorT& evaluator,
+        const int depth, const std::size_t pv_count) -> MultiPVResult
+    {
+        return run_workers(state, evaluator, depth,
+            [&](Worker& main)
+            {
+                auto moves = main.root_moves(state, depth);
+                main.search_root(moves, -fixed_inf, fixed_inf, depth, std::max(pv_count, std::size_t{1}));
+                MultiPVResult res;
+                for (const auto& [move, score, pv] : moves | std::views::take(pv_count))
+                    res.moves.push_back({.move = move, .score = from_fixed_score(score), .pv = {pv.begin(), pv.end()}});
+                return res;
+            });
+    }
+
+    template <typename EvaluatorT>
+    auto BasicMidgameSearcher<EvaluatorT>::search_timed(const GameState& state, const EvaluatorT& evaluator,
+        const std::chrono::nanoseconds time_budget, int max_depth) -> SolveResult
+    {
+        const auto start = Clock::now();
+        max_depth = std::min(max_depth, state.board.count_empty());
+        return run_workers(state, evaluator, max_depth,
+            [&](Worker& main)
+            {
+                main.set_deadline(start + time_budget);
+                auto moves = main.root_moves(state, 1);
+                SolveResult res{.move = moves.front().move, .pv = {moves.front().move}};
+                int best_score = -fixed_inf;
+                Clock::duration previous_iteration{};
+                for (int depth = 1; depth <= max_depth; depth++)
+                {
+                    const auto iteration_start = Clock::now();
+                    int alpha = -fixed_inf, beta = fixed_inf;
+                    if (res.depth > 0)
+                    {
+                        alpha = std::max(best_score - aspiration_window, -fixed_inf);
+                        beta = std::min(best_score + aspiration_window, fixed_inf);
+                    }
+                    int score;
+                    while (true)
+                    {
+                        score = main.search_root(moves, alpha, beta, depth);
+                        if (main.aborted())
+                            break;
+                        if (score <= alpha && alpha > -fixed_inf) // Fail low, re-search with the lower half opened
+                            alpha = -fixed_inf;
+                        else if (score >= beta && beta < fixed_inf) // Fail high
+                            beta = fixed_inf;
+                        else
+                            break;
+                    }
+                    if (main.aborted()) // Results of an unfinished iteration are not reliable
+                        break;
+
+                    // Later iterations search the moves in the order of the previous scores
+                    std::ranges::stable_sort(moves, std::greater{}, &Worker::RootMove::score);
+                    const bool unstable =
+                        moves.front().move != res.move || std::abs(score - best_score) > unstable_score_change;
+                    best_score = score;
+                    res.score = from_fixed_score(score);
+                    res.move = moves.front().move;
+                    res.depth = depth;
+                    res.pv.assign(moves.front().pv.begin(), moves.front().pv.end());
+
+                    // Stop early if the best move is stable, and do not start an iteration that is not going to finish
+                    const auto now = Clock::now();
+                    const auto elapsed = now - start;
+                    const auto iteration = now - iteration_start;
+                    if (elapsed >= (unstable ? time_budget : time_budget / 2))
+                        break;
+                    const double branching_factor = previous_iteration.count() > 0
+                        ? std::clamp(static_cast<double>(iteration.count()) /
+                                  static_cast<double>(previous_iteration.count()),
+                              min_branching_factor, max_branching_factor)
+                        : default_branching_factor;
+                    if (elapsed + std::chrono::duration_cast<Clock::duration>(iteration * branching_factor) >
+                        time_budget)
+                        break;
+                    previous_iteration = iteration;
+                }
+                return res;
+            });
+    }
+
+    template <typename EvaluatorT>
+    void BasicMidgameSearcher<EvaluatorT>::set_probcut(std::optional<ProbCutParameters> params, const float threshold)
+    {
+        probcut_ = std::move(params);
+        probcut_threshold_ = threshold;
+    }
+
+    template <typename EvaluatorT>
+    void BasicMidgameSearcher<EvaluatorT>::set_thread_count(const std::size_t threads)
+    {
+        if (threads == 0)
+            throw std::invalid_argument("A search needs at least one thread");
+        stop_helper_threads();
+        workers_.resize(std::min(workers_.size(), threads));
+        while (workers_.size() < threads)
+            workers_.push_back(std::make_unique<Worker>(*this, !workers_.empty()));
+        for (std::size_t i = 1; i < threads; i++)
+            helper_threads_.emplace_back(&BasicMidgameSearcher::helper_loop, this, i, search_generation_);
+    }
+
+} // namespace flr
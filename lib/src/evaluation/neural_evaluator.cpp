@@ -0,0 +1,405 @@
+#include "fluorine/evaluation/neural_evaluator.h"
+
+#include <fstream>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <clu/random.h>
+
+#ifdef __AVX2__
+    #include <immintrin.h>
+#endif
+
+#include "fluorine/utils/bit.h"
+#include "midgame_searcher_impl.h"
+#include "../utils/stream_io.h"
+
+namespace flr
+{
+    namespace
+    {
+        constexpr std::uint32_t network_magic = 0x4e52'4c46; // "FLRN"
+        constexpr std::uint32_t network_version = 1;
+
+        // Largest hidden layer accepted when loading, so that a corrupted file fails instead of allocating a lot
+        constexpr std::size_t max_hidden_size = 1 << 16;
+
+        // Quantized activations are in [0, activation_scale], so that the products of the activations and the
+        // 8-bit output weights summed in pairs still fit in 16 bits
+        constexpr int activation_scale = 127;
+
+        std::size_t parameter_count(const std::size_t hidden_size, const std::size_t stages) noexcept
+        {
+            return (NeuralEvaluator::input_size + 1 + stages) * hidden_size + stages;
+        }
+
+        void check_sizes(const std::size_t hidden_size, const std::size_t stages)
+        {
+            if (hidden_size == 0 || hidden_size % 32 != 0)
+                throw std::runtime_error("The hidden layer size must be a positive multiple of 32");
+            if (stages == 0)
+                throw std::runtime_error("There must be at least one stage");
+        }
+    } // namespace
+
+    NeuralEvaluator::NeuralEvaluator(const std::size_t hidden_size, const std::size_t stages):
+        hidden_size_(hidden_size), stages_(stages)
+    {
+        check_sizes(hidden_size_, stages_);
+        params_.resize(parameter_count(hidden_size_, stages_));
+    }
+
+    std::unique_ptr<Evaluator> NeuralEvaluator::clone() const
+    {
+        auto res = std::make_unique<NeuralEvaluator>(hidden_size_, stages_);
+        res->params_ = params_;
+        return res;
+    }
+
+    float NeuralEvaluator::evaluate(const Board& board) const
+    {
+        const std::size_t stage = stage_of(board);
+        if (stage == stages_) [[unlikely]]
+            return static_cast<float>(board.disk_difference());
+        thread_local std::vector<float> hidden;
+        hidden.resize(hidden_size_);
+        accumulate(board, hidden.data());
+        const float* weights = output_weights(stage);
+        float res = output_bias(stage);
+        for (std::size_t i = 0; i < hidden_size_; i++)
+            res += std::clamp(hidden[i], 0.0f, 1.0f) * weights[i];
+        return res;
+    }
+
+    float NeuralEvaluator::optimize(
+        const std::span<const DataPoint> dataset, const std::size_t batch_size, const float lr)
+    {
+        float total_se = 0.0f;
+        std::vector<float> hidden(hidden_size_);
+        const std::size_t hidden_bias_offset = input_size * hidden_size_;
+        const std::size_t output_offset = hidden_bias_offset + hidden_size_;
+        const std::size_t output_bias_offset = output_offset + stages_ * hidden_size_;
+        for (std::size_t i = 0; i < dataset.size(); i += batch_size)
+        {
+            if (gradients_.empty())
+                gradients_.resize(params_.size());
+            else
+                std::ranges::fill(gradients_, 0.0f);
+            const std::size_t end = std::min(dataset.size(), i + batch_size);
+            const float mult = 2.0f * lr / static_cast<float>(end - i);
+            float batch_se = 0.0f;
+            for (std::size_t j = i; j < end; j++)
+            {
+                const auto& [board, bounds] = dataset[j];
+                const std::size_t stage = stage_of(board);
+                if (stage == stages_) [[unlikely]]
+                    continue;
+                accumulate(board, hidden.data());
+                const float* weights = output_weights(stage);
+                float predicted = output_bias(stage);
+                for (std::size_t k = 0; k < hidden_size_; k++)
+                    predicted += std::clamp(hidden[k], 0.0f, 1.0f) * weights[k];
+                const float error = bounds.error(predicted);
+                if (error == 0.0f)
+                    continue;
+                batch_se += error * error;
+                const float grad = std::clamp(mult * error, -2.0f, 2.0f); // Clip gradient
+
+                // Back-propagate to the hidden layer, whose activation only passes gradients inside the clipping
+                // range, and reuse the hidden buffer for its gradients
+                float* output_grads = gradients_.data() + output_offset + stage * hidden_size_;
+                gradients_[output_bias_offset + stage] += grad;
+                for (std::size_t k = 0; k < hidden_size_; k++)
+                {
+                    const float pre_activation = hidden[k];
+                    output_grads[k] += grad * std::clamp(pre_activation, 0.0f, 1.0f);
+                    hidden[k] = pre_activation > 0.0f && pre_activation < 1.0f ? grad * weights[k] : 0.0f;
+                }
+                const auto add_hidden_grads = [&](const std::size_t offset)
+                {
+                    float* grads = gradients_.data() + offset;
+                    for (std::size_t k = 0; k < hidden_size_; k++)
+                        grads[k] += hidden[k];
+                };
+                add_hidden_grads(hidden_bias_offset);
+                for (const int square : SetBits{board.black})
+                    add_hidden_grads(static_cast<std::size_t>(square) * hidden_size_);
+                for (const int square : SetBits{board.white})
+                    add_hidden_grads((cell_count + static_cast<std::size_t>(square)) * hidden_size_);
+            }
+            total_se += batch_se;
+            for (std::size_t k = 0; k < params_.size(); k++)
+                params_[k] -= gradients_[k];
+        }
+        return total_se / static_cast<float>(dataset.size());
+    }
+
+    void NeuralEvaluator::randomize_weights()
+    {
+        // Small input weights and a hidden bias in the middle of the clipping range keep the activations away from
+        // the flat parts of the clipped ReLU at the start of the training
+        auto& rng = clu::thread_rng();
+        std::normal_distribution input_dist(0.0f, 0.05f);
+        std::normal_distribution output_dist(0.0f, 1.0f / std::sqrt(static_cast<float>(hidden_size_)));
+        const std::size_t hidden_bias_offset = input_size * hidden_size_;
+        const std::size_t output_offset = hidden_bias_offset + hidden_size_;
+        const std::size_t output_bias_offset = output_offset + stages_ * hidden_size_;
+        for (std::size_t i = 0; i < hidden_bias_offset; i++)
+            params_[i] = input_dist(rng);
+        std::fill_n(params_.data() + hidden_bias_offset, hidden_size_, 0.5f);
+        for (std::size_t i = output_offset; i < output_bias_offset; i++)
+            params_[i] = output_dist(rng);
+        std::fill_n(params_.data() + output_bias_offset, stages_, 0.0f);
+    }
+
+    std::unique_ptr<NeuralEvaluator> NeuralEvaluator::load(std::istream& stream)
+    {
+        const auto magic = read<std::uint32_t>(stream);
+        const auto version = read<std::uint32_t>(stream);
+        const auto hidden_size = read<std::uint64_t>(stream);
+        const auto stages = read<std::uint64_t>(stream);
+        if (!stream)
+            throw std::runtime_error("Failed to read the network");
+        if (magic != network_magic)
+            throw std::runtime_error("Not a network file");
+        if (version != network_version)
+            throw std::runtime_error("Unsupported network version");
+        if (hidden_size > max_hidden_size || stages > cell_count)
+            throw std::runtime_error("Invalid network size");
+        auto res = std::make_unique<NeuralEvaluator>(hidden_size, stages);
+        stream.read(reinterpret_cast<char*>(res->params_.data()),
+            static_cast<std::streamsize>(sizeof(float) * res->params_.size()));
+        if (!stream)
+            throw std::runtime_error("Failed to read the network");
+        return res;
+    }
+
+    std::unique_ptr<NeuralEvaluator> NeuralEvaluator::load(const std::filesystem::path& path)
+    {
+        std::ifstream stream(path, std::ios::binary);
+        return load(stream);
+    }
+
+    void NeuralEvaluator::save(std::ostream& stream) const
+    {
+        write(stream, network_magic);
+        write(stream, network_version);
+        write(stream, static_cast<std::uint64_t>(hidden_size_));
+        write(stream, static_cast<std::uint64_t>(stages_));
+        stream.write(reinterpret_cast<const char*>(params_.data()),
+            static_cast<std::streamsize>(sizeof(float) * params_.size()));
+    }
+
+    std::size_t NeuralEvaluator::stage_of(const Board& board) const noexcept { return flr::stage_of(board, stages_); }
+
+    const float* NeuralEvaluator::input_weights(const std::size_t input) const noexcept
+    {
+        return params_.data() + input * hidden_size_;
+    }
+
+    const float* NeuralEvaluator::hidden_biases() const noexcept { return input_weights(input_size); }
+
+    const float* NeuralEvaluator::output_weights(const std::size_t stage) const noexcept
+    {
+        return hidden_biases() + hidden_size_ * (1 + stage);
+    }
+
+    float NeuralEvaluator::output_bias(const std::size_t stage) const noexcept
+    {
+        return output_weights(stages_)[stage];
+    }
+
+    void NeuralEvaluator::accumulate(const Board& board, float* hidden) const noexcept
+    {
+        std::copy_n(hidden_biases(), hidden_size_, hidden);
+        const auto add_row = [&](const std::size_t input)
+        {
+            const float* row = input_weights(input);
+            for (std::size_t i = 0; i < hidden_size_; i++)
+                hidden[i] += row[i];
+        };
+        for (const int square : SetBits{board.black})
+            add_row(static_cast<std::size_t>(square));
+        for (const int square : SetBits{board.white})
+            add_row(cell_count + static_cast<std::size_t>(square));
+    }
+
+    QuantizedNeuralEvaluator::QuantizedNeuralEvaluator(const NeuralEvaluator& evaluator):
+        hidden_size_(evaluator.hidden_size_), stages_(evaluator.stages_)
+    {
+        const auto quantize = [](const float weight)
+        { return std::round(static_cast<double>(weight) * static_cast<double>(activation_scale)); };
+
+        // Each square is either empty, or has a disk of one of the colors, so the sum of the largest row of each
+        // square bounds the hidden layer for every position. This is checked before narrowing the weights to 16
+        // bits, so that the weights of a diverged network cannot wrap around into range.
+        const float* input_weights = evaluator.input_weights(0);
+        const float* hidden_biases = evaluator.hidden_biases();
+        for (std::size_t i = 0; i < hidden_size_; i++)
+        {
+            double bound = std::abs(quantize(hidden_biases[i]));
+            for (std::size_t square = 0; square < cell_count; square++)
+                bound += std::max(std::abs(quantize(input_weights[square * hidden_size_ + i])),
+                    std::abs(quantize(input_weights[(cell_count + square) * hidden_size_ + i])));
+            if (!(bound <= std::numeric_limits<std::int16_t>::max())) // Also true for NaN
+                throw std::runtime_error("The hidden layer weights are too large to be quantized");
+        }
+        const auto narrow = [&](const float weight) { return static_cast<std::int16_t>(quantize(weight)); };
+        input_weights_.resize(NeuralEvaluator::input_size * hidden_size_);
+        std::ranges::transform(std::span(input_weights, input_weights_.size()), input_weights_.begin(), narrow);
+        hidden_biases_.resize(hidden_size_);
+        std::ranges::transform(std::span(hidden_biases, hidden_size_), hidden_biases_.begin(), narrow);
+
+        // The output weights of each stage get the largest power of two scale with which they fit in 8 bits
+        output_weights_.resize(stages_ * hidden_size_);
+        output_scales_.resize(stages_);
+        output_biases_.resize(stages_);
+        for (std::size_t stage = 0; stage < stages_; stage++)
+        {
+            const std::span weights(evaluator.output_weights(stage), hidden_size_);
+            float max_abs = 0.0f;
+            for (const float weight : weights)
+                max_abs = std::max(max_abs, std::abs(weight));
+            if (!std::isfinite(max_abs))
+                throw std::runtime_error("The output weights are too large to be quantized");
+            int exponent = 0;
+            if (max_abs > 0.0f)
+                exponent = static_cast<int>(std::floor(std::log2(static_cast<float>(activation_scale) / max_abs)));
+            while (std::lround(std::ldexp(max_abs, exponent)) > activation_scale)
+                exponent--;
+            for (std::size_t i = 0; i < hidden_size_; i++)
+                output_weights_[stage * hidden_size_ + i] =
+                    static_cast<std::int8_t>(std::lround(std::ldexp(weights[i], exponent)));
+            output_scales_[stage] = std::ldexp(1.0f / static_cast<float>(activation_scale), -exponent);
+            output_biases_[stage] = evaluator.output_bias(stage);
+        }
+    }
+
+    std::unique_ptr<Evaluator> QuantizedNeuralEvaluator::clone() const
+    {
+        auto res = std::unique_ptr<QuantizedNeuralEvaluator>(new QuantizedNeuralEvaluator);
+        res->hidden_size_ = hidden_size_;
+        res->stages_ = stages_;
+        res->input_weights_ = input_weights_;
+        res->hidden_biases_ = hidden_biases_;
+        res->output_weights_ = output_weights_;
+        res->output_scales_ = output_scales_;
+        res->output_biases_ = output_biases_;
+        return res;
+    }
+
+    float QuantizedNeuralEvaluator::evaluate(const Board& board) const
+    {
+        const std::size_t stage = stage_of(board);
+        if (stage == stages_) [[unlikely]]
+            return static_cast<float>(board.disk_difference());
+        thread_local CacheAlignedVector<std::int16_t> accumulator;
+        accumulator.assign(hidden_biases_.begin(), hidden_biases_.end());
+        add_rows(accumulator.data(), board.black, 0, 0);
+        add_rows(accumulator.data(), board.white, 0, cell_count);
+        return propagate(accumulator.data(), stage);
+    }
+
+    // Overridden so that calls on the final class resolve evaluate statically as well
+    int QuantizedNeuralEvaluator::evaluate_fixed(const Board& board) const { return to_fixed_score(evaluate(board)); }
+
+    QuantizedNeuralEvaluator::FeatureState QuantizedNeuralEvaluator::features_of(const Board& board) const
+    {
+        FeatureState res;
+        res.accumulators_.resize(hidden_size_ * 2);
+        std::ranges::copy(hidden_biases_, res.accumulators_.begin());
+        std::ranges::copy(hidden_biases_, res.accumulators_.begin() + static_cast<std::ptrdiff_t>(hidden_size_));
+        update_features(res, Board::empty, board);
+        return res;
+    }
+
+    void QuantizedNeuralEvaluator::update_features(
+        FeatureState& features, const Board& from, const Board& to) const noexcept
+    {
+        const BitBoard black_added = to.black & ~from.black;
+        const BitBoard black_removed = from.black & ~to.black;
+        const BitBoard white_added = to.white & ~from.white;
+        const BitBoard white_removed = from.white & ~to.white;
+        std::int16_t* black_view = features.accumulators_.data();
+        std::int16_t* white_view = black_view + hidden_size_;
+        add_rows(black_view, black_added, black_removed, 0);
+        add_rows(black_view, white_added, white_removed, cell_count);
+        add_rows(white_view, white_added, white_removed, 0);
+        add_rows(white_view, black_added, black_removed, cell_count);
+    }
+
+    float QuantizedNeuralEvaluator::evaluate(const GameState& state, const FeatureState& features) const noexcept
+    {
+        const std::size_t stage = stage_of(state.board);
+        if (stage == stages_) [[unlikely]]
+            return static_cast<float>(state.disk_difference());
+        const std::int16_t* accumulator =
+            features.accumulators_.data() + (state.current == Color::black ? 0 : hidden_size_);
+        return propagate(accumulator, stage);
+    }
+
+    int QuantizedNeuralEvaluator::evaluate_fixed(const GameState& state, const FeatureState& features) const noexcept
+    {
+        return to_fixed_score(evaluate(state, features));
+    }
+
+    std::size_t QuantizedNeuralEvaluator::stage_of(const Board& board) const noexcept
+    {
+        return flr::stage_of(board, stages_);
+    }
+
+    // The rows are plain loops of 16-bit additions, which the compiler vectorizes well for any instruction set
+    void QuantizedNeuralEvaluator::add_rows(std::int16_t* accumulator, const BitBoard added, const BitBoard removed,
+        const std::size_t offset) const noexcept
+    {
+        for (const int square : SetBits{added})
+        {
+            const std::int16_t* row =
+                input_weights_.data() + (offset + static_cast<std::size_t>(square)) * hidden_size_;
+            for (std::size_t i = 0; i < hidden_size_; i++)
+                accumulator[i] = static_cast<std::int16_t>(accumulator[i] + row[i]);
+        }
+        for (const int square : SetBits{removed})
+        {
+            const std::int16_t* row =
+                input_weights_.data() + (offset + static_cast<std::size_t>(square)) * hidden_size_;
+            for (std::size_t i = 0; i < hidden_size_; i++)
+                accumulator[i] = static_cast<std::int16_t>(accumulator[i] - row[i]);
+        }
+    }
+
+    float QuantizedNeuralEvaluator::propagate(const std::int16_t* accumulator, const std::size_t stage) const noexcept
+    {
+        const std::int8_t* weights = output_weights_.data() + stage * hidden_size_;
+#if defined(__AVX2__)
+        // Clip to [0, 127] while packing to unsigned bytes, then multiply with the signed weights, the pairs of
+        // products are summed in 16 bits and widened to 32 bits by a multiplication with ones
+        const __m256i max = _mm256_set1_epi16(activation_scale);
+        const __m256i ones = _mm256_set1_epi16(1);
+        __m256i sum = _mm256_setzero_si256();
+        for (std::size_t i = 0; i < hidden_size_; i += 32)
+        {
+            const __m256i low = _mm256_min_epi16(
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(accumulator + i)), max);
+            const __m256i high = _mm256_min_epi16(
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(accumulator + i + 16)), max);
+            // Packing works on each 128-bit lane, so the quarters are permuted back into the order of the weights
+            const __m256i activations = _mm256_permute4x64_epi64(_mm256_packus_epi16(low, high), 0b11'01'10'00);
+            const __m256i w = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(weights + i));
+            sum = _mm256_add_epi32(sum, _mm256_madd_epi16(_mm256_maddubs_epi16(activations, w), ones));
+        }
+        __m128i res = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+        res = _mm_add_epi32(res, _mm_shuffle_epi32(res, 0b01'00'11'10));
+        res = _mm_add_epi32(res, _mm_shuffle_epi32(res, 0b10'11'00'01));
+        const int total = _mm_cvtsi128_si32(res);
+#else
+        int total = 0;
+        for (std::size_t i = 0; i < hidden_size_; i++)
+            total += std::clamp<int>(accumulator[i], 0, activation_scale) * weights[i];
+#endif
+        return static_cast<float>(total) * output_scales_[stage] + output_biases_[stage];
+    }
+
+    // Instantiated here so that evaluate can be inlined into the search
+    template class FLUORINE_API BasicMidgameSearcher<QuantizedNeuralEvaluator>;
+} // namespace flr
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <vector>
+
+#ifdef __AVX2__
+    #include <immintrin.h>
+#endif
+
+#include "fluorine/evaluation/pattern.h"
+
+// Pattern extraction and the pattern instance tables shared by the pattern evaluators
+namespace flr
+{
+    inline constexpr std::size_t instance_alignment = 16; // Indices in an AVX2 register, or weights in an AVX-512 one
+
+#ifdef __AVX512F__
+    // Without optimizations, GCC defines the AVX-512 gathers as macros passing an all-ones mask as a signed integer,
+    // which trips -Wsign-conversion wherever they are expanded
+    #if defined(__GNUC__) && !defined(__clang__)
+        #pragma GCC diagnostic push
+        #pragma GCC diagnostic ignored "-Wsign-conversion"
+    #endif
+    template <int Scale>
+    __m512 gather_ps(const __m512i offsets, const void* base) noexcept
+    {
+        return _mm512_i32gather_ps(offsets, base, Scale);
+    }
+
+    template <int Scale>
+    __m512i gather_epi32(const __m512i offsets, const void* base) noexcept
+    {
+        return _mm512_i32gather_epi32(offsets, base, Scale);
+    }
+    #if defined(__GNUC__) && !defined(__clang__)
+        #pragma GCC diagnostic pop
+    #endif
+#endif
+
+    // Instances are numbered by pattern and then by symmetry, and padded with ones that always have index 0.
+    // The table of each instance starts at its offset in a stage, and the offset of the padding is 0, which is a
+    // zero weight at the start of each stage. Returns the size of the tables of a stage.
+    // The patterns are anything with a mask named pattern and a symmetry.
+    template <typename Patterns>
+    std::size_t build_instance_offsets(const Patterns& patterns, std::vector<std::uint32_t>& offsets)
+    {
+        offsets.clear();
+        std::uint32_t offset = 1;
+        for (const auto& pattern : patterns)
+        {
+            offsets.insert(offsets.end(), instance_count_of(pattern.symmetry), offset);
+            offset += powers_of_3[static_cast<std::size_t>(std::popcount(pattern.pattern))];
+        }
+        const std::size_t padded = (offsets.size() + instance_alignment - 1) / instance_alignment * instance_alignment;
+        offsets.resize(padded, 0);
+        return offset;
+    }
+
+    // Changes of the feature indices when a black or a white disk is placed on each square, the features being the
+    // indices of all the instances from the perspective of black and then of white.
+    template <typename Patterns>
+    void build_feature_deltas(const Patterns& patterns, const std::size_t padded_instance_count,
+        std::vector<std::uint16_t>& black_deltas, std::vector<std::uint16_t>& white_deltas)
+    {
+        const std::size_t feature_size = padded_instance_count * 2;
+        black_deltas.assign(cell_count * feature_size, 0);
+        white_deltas.assign(cell_count * feature_size, 0);
+        for (std::size_t sq = 0; sq < cell_count; sq++)
+        {
+            const auto transformed = transform_d4(bit_of(static_cast<Coords>(sq)));
+            std::uint16_t* black = black_deltas.data() + sq * feature_size;
+            std::uint16_t* white = white_deltas.data() + sq * feature_size;
+            std::size_t instance = 0;
+            for (const auto& pattern : patterns)
+            {
+                const std::size_t n = instance_count_of(pattern.symmetry);
+                for (std::size_t i = 0; i < n; i++, instance++)
+                {
+                    if ((transformed[i] & pattern.pattern) == 0)
+                        continue;
+                    // The digit of the square is its rank among the bits of the pattern,
+                    // the player's own disk counts as 1 and the opponent's as 2
+                    const auto rank = std::popcount(pattern.pattern & (transformed[i] - 1));
+                    const std::uint16_t power = powers_of_3[static_cast<std::size_t>(rank)];
+                    black[instance] = power;
+                    black[padded_instance_count + instance] = static_cast<std::uint16_t>(power * 2);
+                    white[instance] = static_cast<std::uint16_t>(power * 2);
+                    white[padded_instance_count + instance] = power;
+                }
+            }
+        }
+    }
+
+    // Apply the deltas of every changed square to the feature indices
+    inline void update_feature_indices(std::uint16_t* features, const std::size_t feature_size,
+        const std::uint16_t* black_deltas, const std::uint16_t* white_deltas, const Board& from,
+        const Board& to) noexcept
+    {
+        // Flipping a disk is removing it and placing one of the other color
+        const BitBoard new_black = to.black & ~from.black;
+        const BitBoard new_white = to.white & ~from.white;
+        const BitBoard old_black = from.black & ~to.black;
+        const BitBoard old_white = from.white & ~to.white;
+        const auto delta_of = [&](const std::uint16_t* deltas, const int square, const std::size_t offset)
+        { return deltas + static_cast<std::size_t>(square) * feature_size + offset; };
+        // Each chunk of indices is loaded once and all the changed squares are accumulated into it
+        for (std::size_t i = 0; i < feature_size; i += instance_alignment)
+        {
+            std::uint16_t* indices = features + i;
+#ifdef __AVX2__
+            const auto load = [](const std::uint16_t* ptr)
+            { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr)); };
+            __m256i acc = load(indices);
+            for (const int square : SetBits{new_black})
+                acc = _mm256_add_epi16(acc, load(delta_of(black_deltas, square, i)));
+            for (const int square : SetBits{new_white})
+                acc = _mm256_add_epi16(acc, load(delta_of(white_deltas, square, i)));
+            for (const int square : SetBits{old_black})
+                acc = _mm256_sub_epi16(acc, load(delta_of(black_deltas, square, i)));
+            for (const int square : SetBits{old_white})
+                acc = _mm256_sub_epi16(acc, load(delta_of(white_deltas, square, i)));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(indices), acc);
+#else
+            const auto apply = [&](const BitBoard squares, const std::uint16_t* deltas, const int sign)
+            {
+                for (const int square : SetBits{squares})
+                {
+                    const std::uint16_t* delta = delta_of(deltas, square, i);
+                    for (std::size_t j = 0; j < instance_alignment; j++)
+                        indices[j] = static_cast<std::uint16_t>(indices[j] + sign * delta[j]);
+                }
+            };
+            apply(new_black, black_deltas, 1);
+            apply(new_white, white_deltas, 1);
+            apply(old_black, black_deltas, -1);
+            apply(old_white, white_deltas, -1);
+#endif
+        }
+    }
+
+    // Fill chunks of instance_alignment instance indices of a board in the order of the instances, calling
+    // consume(begin, indices) on each chunk. The padding instances at the end get zero indices.
+    // The patterns also need an extractor here.
+    template <typename Patterns, typename F>
+    void for_each_index_chunk(const Patterns& patterns, const std::array<BitBoard, 8>& self_d4,
+        const std::array<BitBoard, 8>& opponent_d4, F&& consume)
+    {
+        std::array<std::uint16_t, instance_alignment> indices{};
+        std::size_t begin = 0, filled = 0;
+        for (const auto& pattern : patterns)
+        {
+            const std::size_t n = instance_count_of(pattern.symmetry);
+            for (std::size_t i = 0; i < n; i++)
+            {
+                indices[filled++] = pattern.extractor({self_d4[i], opponent_d4[i]});
+                if (filled == instance_alignment)
+                {
+                    consume(begin, indices.data());
+                    begin += instance_alignment;
+                    filled = 0;
+                }
+            }
+        }
+        if (filled > 0)
+        {
+            std::fill(indices.begin() + static_cast<std::ptrdiff_t>(filled), indices.end(), std::uint16_t{});
+            consume(begin, indices.data());
+        }
+    }
+} // namespace flr
@@ -0,0 +1,170 @@
+#include "fluorine/evaluation/probcut.h"
+
+#include <fstream>
+#include <cmath>
+#include <optional>
+#include <stdexcept>
+
+#include "fluorine/evaluation/midgame_searcher.h"
+#include "fluorine/utils/tui.h"
+#include "../utils/stream_io.h"
+
+namespace flr
+{
+    ProbCutParameters::ProbCutParameters(
+        const std::size_t stages, const int min_depth, const int max_depth, const std::size_t checks):
+        stages_(stages), min_depth_(min_depth), max_depth_(max_depth), checks_(checks)
+    {
+        if (stages_ == 0 || min_depth_ < 2 || max_depth_ < min_depth_ || checks_ == 0)
+            throw std::runtime_error("Invalid ProbCut parameter ranges");
+        regressions_.resize(stages_ * static_cast<std::size_t>(max_depth_ - min_depth_ + 1) * checks_);
+    }
+
+    std::size_t ProbCutParameters::stage_of(const Board& board) const noexcept
+    {
+        return std::min(flr::stage_of(board, stages_), stages_ - 1);
+    }
+
+    ProbCutParameters::Regression& ProbCutParameters::regression(
+        const std::size_t stage, const int depth, const std::size_t check) noexcept
+    {
+        return regressions_[index_of(stage, depth, check)];
+    }
+
+    const ProbCutParameters::Regression& ProbCutParameters::regression(
+        const std::size_t stage, const int depth, const std::size_t check) const noexcept
+    {
+        return regressions_[index_of(stage, depth, check)];
+    }
+
+    std::size_t ProbCutParameters::index_of(
+        const std::size_t stage, const int depth, const std::size_t check) const noexcept
+    {
+        assert(stage < stages_ && depth >= min_depth_ && depth <= max_depth_ && check < checks_);
+        const std::size_t depth_index = stage * static_cast<std::size_t>(max_depth_ - min_depth_ + 1) +
+            static_cast<std::size_t>(depth - min_depth_);
+        return depth_index * checks_ + check;
+    }
+
+    ProbCutParameters ProbCutParameters::load(std::istream& stream)
+    {
+        const auto stages = read<std::size_t>(stream);
+        const auto min_depth = read<int>(stream);
+        const auto max_depth = read<int>(stream);
+        const auto checks = read<std::size_t>(stream);
+        if (!stream)
+            throw std::runtime_error("Failed to read ProbCut parameters");
+        ProbCutParameters res(stages, min_depth, max_depth, checks);
+        for (auto& [slope, intercept, sigma] : res.regressions_)
+        {
+            slope = read<float>(stream);
+            intercept = read<float>(stream);
+            sigma = read<float>(stream);
+        }
+        if (!stream)
+            throw std::runtime_error("Failed to read ProbCut parameters");
+        return res;
+    }
+
+    ProbCutParameters ProbCutParameters::load(const std::filesystem::path& path)
+    {
+        std::ifstream stream(path, std::ios::binary);
+        return load(stream);
+    }
+
+    void ProbCutParameters::save(std::ostream& stream) const
+    {
+        write(stream, stages_);
+        write(stream, min_depth_);
+        write(stream, max_depth_);
+        write(stream, checks_);
+        for (const auto& [slope, intercept, sigma] : regressions_)
+        {
+            write(stream, slope);
+            write(stream, intercept);
+            write(stream, sigma);
+        }
+    }
+
+    void ProbCutParameters::save(const std::filesystem::path& path) const
+    {
+        std::ofstream stream(path, std::ios::binary);
+        save(stream);
+    }
+
+    ProbCutParameters calibrate_probcut(const Evaluator& evaluator, const std::span<const GameState> positions,
+        const ProbCutCalibrationOptions& options)
+    {
+        ProbCutParameters res(options.stages, options.min_depth, options.max_depth, options.checks);
+        const auto depth_count = static_cast<std::size_t>(options.max_depth - options.min_depth + 1);
+
+        // Sums for the least squares fit of each (stage, depth) pair
+        struct Samples
+        {
+            double n = 0, x = 0, y = 0, xx = 0, xy = 0, yy = 0;
+        };
+        std::vector<Samples> samples(options.stages * depth_count * options.checks);
+        const auto samples_of = [&](const std::size_t stage, const int depth, const std::size_t check) -> Samples&
+        {
+            const std::size_t depth_index = stage * depth_count + static_cast<std::size_t>(depth - options.min_depth);
+            return samples[depth_index * options.checks + check];
+        };
+
+        std::optional<ProgressBar> bar;
+        if (options.show_progress)
+            bar.emplace("Calibrating ProbCut", positions.size());
+        MidgameSearcher searcher;
+        std::vector<float> scores(static_cast<std::size_t>(options.max_depth) + 1);
+        for (const auto& state : positions)
+        {
+            // Every shallow depth is smaller than the deep one, so one pass over all depths covers both. Depth 0 is
+            // the static evaluation, which the cheapest checks of small depths use.
+            for (int depth = 0; depth <= options.max_depth; depth++)
+                scores[static_cast<std::size_t>(depth)] = searcher.evaluate(state, evaluator, depth).score;
+            const std::size_t stage = res.stage_of(state.board);
+            for (int depth = options.min_depth; depth <= options.max_depth; depth++)
+                for (std::size_t check = 0; check < options.checks; check++)
+                {
+                    const int shallow_depth = ProbCutParameters::shallow_depth(depth, check);
+                    if (shallow_depth < 0)
+                        break;
+                    const double x = scores[static_cast<std::size_t>(shallow_depth)];
+                    const double y = scores[static_cast<std::size_t>(depth)];
+                    auto& s = samples_of(stage, depth, check);
+                    s.n += 1;
+                    s.x += x;
+                    s.y += y;
+                    s.xx += x * x;
+                    s.xy += x * y;
+                    s.yy += y * y;
+                }
+            if (bar)
+                bar->tick();
+        }
+
+        for (std::size_t stage = 0; stage < options.stages; stage++)
+            for (int depth = options.min_depth; depth <= options.max_depth; depth++)
+                for (std::size_t check = 0; check < options.checks; check++)
+                {
+                    const auto& [n, x, y, xx, xy, yy] = samples_of(stage, depth, check);
+                    if (n < static_cast<double>(options.min_samples))
+                        continue;
+                    const double var_x = xx / n - (x / n) * (x / n);
+                    const double cov_xy = xy / n - (x / n) * (y / n);
+                    const double slope = var_x > 0 ? cov_xy / var_x : 1.0;
+                    if (slope <= 0) // The shallow search tells nothing about the deep one
+                        continue;
+                    const double intercept = y / n - slope * x / n;
+                    // Mean squared residual of the fitted line, expanded in terms of the sums
+                    const double mse = (yy - 2 * slope * xy - 2 * intercept * y + slope * slope * xx +
+                                           2 * slope * intercept * x + intercept * intercept * n) /
+                        n;
+                    res.regression(stage, depth, check) = {
+                        .slope = static_cast<float>(slope),
+                        .intercept = static_cast<float>(intercept),
+                        .sigma = static_cast<float>(std::sqrt(std::max(mse, 0.0))),
+                    };
+                }
+        return res;
+    }
+} // namespace flr
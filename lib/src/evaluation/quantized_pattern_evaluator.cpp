@@ -0,0 +1,271 @@
+#include "fluorine/evaluation/quantized_pattern_evaluator.h"
+
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+#include "midgame_searcher_impl.h"
+#include "pattern_utils.h"
+
+namespace flr
+{
+    namespace
+    {
+        // The accumulator is in units of 1/2^fraction_bits of a fixed point score
+        constexpr int fraction_bits = 8;
+        constexpr double accumulator_scale = static_cast<double>(score_scale << fraction_bits);
+
+        // Sums the quantized weights of the pattern instances, see WeightSum of LinearPatternEvaluator.
+        // The weights are fetched with 32-bit gathers and sign extended, which reads a few bytes past the last
+        // weight of the table, then they are scaled by the shift of their instance.
+        template <typename WeightT>
+        class QuantizedWeightSum
+        {
+        public:
+            void add(const WeightT* table, const std::uint32_t* offsets, const std::uint32_t* shifts,
+                const std::uint16_t* indices) noexcept
+            {
+#if defined(__AVX512F__)
+                const __m512i idx = _mm512_cvtepu16_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(indices)));
+                const __m512i off = _mm512_loadu_si512(offsets);
+                __m512i weights = gather_epi32<sizeof(WeightT)>(_mm512_add_epi32(idx, off), table);
+                weights = _mm512_srai_epi32(_mm512_slli_epi32(weights, extension_shift), extension_shift);
+                acc_ = _mm512_add_epi32(acc_, _mm512_sllv_epi32(weights, _mm512_loadu_si512(shifts)));
+#elif defined(__AVX2__)
+                const auto gather = [&](const std::size_t begin)
+                {
+                    const __m256i idx =
+                        _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(indices + begin)));
+                    const __m256i off = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(offsets + begin));
+                    __m256i weights = _mm256_i32gather_epi32(
+                        reinterpret_cast<const int*>(table), _mm256_add_epi32(idx, off), sizeof(WeightT));
+                    weights = _mm256_srai_epi32(_mm256_slli_epi32(weights, extension_shift), extension_shift);
+                    const __m256i shift = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(shifts + begin));
+                    return _mm256_sllv_epi32(weights, shift);
+                };
+                low_ = _mm256_add_epi32(low_, gather(0));
+                high_ = _mm256_add_epi32(high_, gather(8));
+#else
+                for (std::size_t i = 0; i < instance_alignment; i++)
+                    acc_ += static_cast<int>(table[offsets[i] + indices[i]]) << shifts[i];
+#endif
+            }
+
+            [[nodiscard]] int sum() const noexcept
+            {
+#if defined(__AVX512F__)
+                return _mm512_reduce_add_epi32(acc_);
+#elif defined(__AVX2__)
+                const __m256i acc = _mm256_add_epi32(low_, high_);
+                __m128i res = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+                res = _mm_add_epi32(res, _mm_shuffle_epi32(res, 0b01'00'11'10));
+                res = _mm_add_epi32(res, _mm_shuffle_epi32(res, 0b10'11'00'01));
+                return _mm_cvtsi128_si32(res);
+#else
+                return acc_;
+#endif
+            }
+
+        private:
+#if defined(__AVX512F__) || defined(__AVX2__)
+            static constexpr int extension_shift = 32 - static_cast<int>(sizeof(WeightT)) * 8;
+#endif
+#if defined(__AVX512F__)
+            __m512i acc_ = _mm512_setzero_si512();
+#elif defined(__AVX2__)
+            __m256i low_ = _mm256_setzero_si256();
+            __m256i high_ = _mm256_setzero_si256();
+#else
+            int acc_ = 0;
+#endif
+        };
+    } // namespace
+
+    template <typename WeightT>
+    BasicQuantizedPatternEvaluator<WeightT>::BasicQuantizedPatternEvaluator(const LinearPatternEvaluator& evaluator):
+        stages_(evaluator.stages_)
+    {
+        patterns_.reserve(evaluator.patterns_.size());
+        for (const auto& pattern : evaluator.patterns_)
+            patterns_.push_back({pattern.pattern, pattern.symmetry, pattern.extractor});
+        stage_table_size_ = round_up_to_cache_lines<WeightT>(build_instance_offsets(patterns_, instance_offsets_));
+        padded_instance_count_ = instance_offsets_.size();
+        feature_size_ = padded_instance_count_ * 2;
+        build_feature_deltas(patterns_, padded_instance_count_, black_deltas_, white_deltas_);
+
+        // Each pattern gets the smallest shift at each stage with which its largest weight still fits in WeightT.
+        // The largest weight of every instance and of every scalar feature at its largest value bound the sum in
+        // the accumulator, which must fit in 32 bits. The scalar features are few, so their weights are just kept
+        // in full precision fixed point.
+        constexpr double max_weight = std::numeric_limits<WeightT>::max();
+        constexpr double max_accumulator = std::numeric_limits<std::int32_t>::max();
+        constexpr double scalar_scale = accumulator_scale * static_cast<double>(scalar_feature_scale);
+        constexpr std::size_t gather_padding = sizeof(std::int32_t) / sizeof(WeightT) - 1;
+        const auto check_finite = [](const std::span<const float> weights)
+        {
+            if (!std::ranges::all_of(weights, [](const float weight) { return std::isfinite(weight); }))
+                throw std::runtime_error("The weights must be finite to be quantized");
+        };
+        weights_.assign(stages_ * stage_table_size_ + gather_padding, 0);
+        shifts_.assign(stages_ * padded_instance_count_, 0);
+        scalar_features_ = evaluator.scalar_features_;
+        scalar_weights_.reserve(stages_ * scalar_features_.size());
+        for (std::size_t stage = 0; stage < stages_; stage++)
+        {
+            WeightT* table = weights_.data() + stage * stage_table_size_ + 1;
+            std::uint32_t* shifts = shifts_.data() + stage * padded_instance_count_;
+            double bound = 0.0;
+            for (const auto& pattern : evaluator.patterns_)
+            {
+                const auto weights = evaluator.weights_at_stage(pattern, stage);
+                check_finite(weights);
+                double max_abs = 0.0;
+                for (const float weight : weights)
+                    max_abs = std::max(max_abs, std::abs(static_cast<double>(weight)));
+                // Checked before searching for the shift, which keeps it below 32
+                if (max_abs * accumulator_scale > max_accumulator)
+                    throw std::runtime_error("The pattern weights are too large to be quantized");
+                std::uint32_t shift = 0;
+                while (std::round(max_abs * accumulator_scale / static_cast<double>(1u << shift)) > max_weight)
+                    shift++;
+                const double scale = accumulator_scale / static_cast<double>(1u << shift);
+                const std::size_t n = instance_count_of(pattern.symmetry);
+                bound += std::round(max_abs * scale) * static_cast<double>(1u << shift) * static_cast<double>(n);
+                for (const auto mapped : *pattern.index_map)
+                    *table++ = static_cast<WeightT>(std::round(static_cast<double>(weights[mapped]) * scale));
+                std::fill_n(shifts, n, shift);
+                shifts += n;
+            }
+            const auto scalar_weights = evaluator.scalar_weights_at_stage(stage);
+            check_finite(scalar_weights);
+            for (const float weight : scalar_weights)
+                bound += std::abs(std::round(static_cast<double>(weight) * scalar_scale)) * static_cast<double>(cell_count);
+            if (bound > max_accumulator)
+                throw std::runtime_error("The weights are too large for the 32-bit accumulator");
+            for (const float weight : scalar_weights)
+                scalar_weights_.push_back(static_cast<int>(std::round(static_cast<double>(weight) * scalar_scale)));
+        }
+    }
+
+    template <typename WeightT>
+    std::unique_ptr<Evaluator> BasicQuantizedPatternEvaluator<WeightT>::clone() const
+    {
+        auto res = std::unique_ptr<BasicQuantizedPatternEvaluator>(new BasicQuantizedPatternEvaluator);
+        res->stages_ = stages_;
+        res->patterns_ = patterns_;
+        res->padded_instance_count_ = padded_instance_count_;
+        res->instance_offsets_ = instance_offsets_;
+        res->weights_ = weights_;
+        res->shifts_ = shifts_;
+        res->scalar_features_ = scalar_features_;
+        res->scalar_weights_ = scalar_weights_;
+        res->stage_table_size_ = stage_table_size_;
+        res->feature_size_ = feature_size_;
+        res->black_deltas_ = black_deltas_;
+        res->white_deltas_ = white_deltas_;
+        return res;
+    }
+
+    template <typename WeightT>
+    float BasicQuantizedPatternEvaluator<WeightT>::evaluate(const Board& board) const
+    {
+        return static_cast<float>(static_cast<double>(evaluate_raw(board)) / accumulator_scale);
+    }
+
+    template <typename WeightT>
+    int BasicQuantizedPatternEvaluator<WeightT>::evaluate_fixed(const Board& board) const
+    {
+        constexpr int max = fixed_inf - 1;
+        return std::clamp((evaluate_raw(board) + (1 << (fraction_bits - 1))) >> fraction_bits, -max, max);
+    }
+
+    template <typename WeightT>
+    typename BasicQuantizedPatternEvaluator<WeightT>::FeatureState BasicQuantizedPatternEvaluator<
+        WeightT>::features_of(const Board& board) const
+    {
+        FeatureState res;
+        res.indices_.resize(feature_size_);
+        update_features(res, Board::empty, board);
+        return res;
+    }
+
+    template <typename WeightT>
+    void BasicQuantizedPatternEvaluator<WeightT>::update_features(
+        FeatureState& features, const Board& from, const Board& to) const noexcept
+    {
+        update_feature_indices(
+            features.indices_.data(), feature_size_, black_deltas_.data(), white_deltas_.data(), from, to);
+    }
+
+    template <typename WeightT>
+    float BasicQuantizedPatternEvaluator<WeightT>::evaluate(
+        const GameState& state, const FeatureState& features) const noexcept
+    {
+        return static_cast<float>(static_cast<double>(evaluate_raw(state, features)) / accumulator_scale);
+    }
+
+    template <typename WeightT>
+    int BasicQuantizedPatternEvaluator<WeightT>::evaluate_fixed(
+        const GameState& state, const FeatureState& features) const noexcept
+    {
+        constexpr int max = fixed_inf - 1;
+        return std::clamp((evaluate_raw(state, features) + (1 << (fraction_bits - 1))) >> fraction_bits, -max, max);
+    }
+
+    template <typename WeightT>
+    std::size_t BasicQuantizedPatternEvaluator<WeightT>::stage_of(const Board& board) const noexcept
+    {
+        return flr::stage_of(board, stages_);
+    }
+
+    template <typename WeightT>
+    int BasicQuantizedPatternEvaluator<WeightT>::evaluate_raw(const Board& board) const noexcept
+    {
+        const std::size_t stage = stage_of(board);
+        if (stage == stages_) [[unlikely]]
+            return (board.disk_difference() * score_scale) << fraction_bits;
+        const WeightT* table = weights_.data() + stage * stage_table_size_;
+        const std::uint32_t* shifts = shifts_.data() + stage * padded_instance_count_;
+        QuantizedWeightSum<WeightT> sum;
+        for_each_index_chunk(patterns_, transform_d4(board.black), transform_d4(board.white),
+            [&](const std::size_t begin, const std::uint16_t* indices)
+            { sum.add(table, instance_offsets_.data() + begin, shifts + begin, indices); });
+        return sum.sum() + evaluate_scalars(board, stage);
+    }
+
+    template <typename WeightT>
+    int BasicQuantizedPatternEvaluator<WeightT>::evaluate_raw(
+        const GameState& state, const FeatureState& features) const noexcept
+    {
+        const std::size_t stage = stage_of(state.board);
+        if (stage == stages_) [[unlikely]]
+            return (state.disk_difference() * score_scale) << fraction_bits;
+        const WeightT* table = weights_.data() + stage * stage_table_size_;
+        const std::uint32_t* shifts = shifts_.data() + stage * padded_instance_count_;
+        const std::uint16_t* indices =
+            features.indices_.data() + (state.current == Color::black ? 0 : padded_instance_count_);
+        QuantizedWeightSum<WeightT> sum;
+        for (std::size_t i = 0; i < padded_instance_count_; i += instance_alignment)
+            sum.add(table, instance_offsets_.data() + i, shifts + i, indices + i);
+        return sum.sum() + evaluate_scalars(state.canonical_board(), stage);
+    }
+
+    template <typename WeightT>
+    int BasicQuantizedPatternEvaluator<WeightT>::evaluate_scalars(
+        const Board& board, const std::size_t stage) const noexcept
+    {
+        const int* weights = scalar_weights_.data() + stage * scalar_features_.size();
+        int res = 0;
+        for (std::size_t i = 0; i < scalar_features_.size(); i++)
+            res += weights[i] * scalar_feature_value(scalar_features_[i], board);
+        return res;
+    }
+
+    template class FLUORINE_API BasicQuantizedPatternEvaluator<std::int16_t>;
+    template class FLUORINE_API BasicQuantizedPatternEvaluator<std::int8_t>;
+
+    // Instantiated here so that evaluate can be inlined into the search
+    template class FLUORINE_API BasicMidgameSearcher<Int16PatternEvaluator>;
+    template class FLUORINE_API BasicMidgameSearcher<Int8PatternEvaluator>;
+} // namespace flr
@@ -0,0 +1,92 @@
+#include "fluorine/evaluation/scalar_features.h"
+
+#include <array>
+
+#include "fluorine/utils/bit.h"
+
+namespace flr
+{
+    namespace
+    {
+        constexpr BitBoard shift_north(const BitBoard bits) noexcept { return bits >> 8; }
+        constexpr BitBoard shift_south(const BitBoard bits) noexcept { return bits << 8; }
+
+        struct Axis
+        {
+            BitBoard (*forward)(BitBoard) noexcept;
+            BitBoard (*backward)(BitBoard) noexcept;
+            BitBoard edges; // Squares with one of their neighbors along the axis off the board
+        };
+
+        constexpr BitBoard border = 0xff818181'818181ffull;
+        constexpr std::array axes{
+            Axis{shift_west, shift_east, 0x81818181'81818181ull},
+            Axis{shift_north, shift_south, 0xff000000'000000ffull},
+            Axis{shift_northwest, shift_southeast, border},
+            Axis{shift_northeast, shift_southwest, border},
+        };
+
+        // Squares whose whole line along the axis is occupied
+        BitBoard find_full_lines(const BitBoard occupied, const Axis& axis) noexcept
+        {
+            // Spread the empty squares along the axis, lines are at most 8 squares long
+            BitBoard empty = ~occupied;
+            for (int i = 0; i < 7; i++)
+                empty |= axis.forward(empty) | axis.backward(empty);
+            return ~empty;
+        }
+
+        BitBoard find_neighbors(const BitBoard bits) noexcept
+        {
+            BitBoard res = 0;
+            for (const auto& axis : axes)
+                res |= axis.forward(bits) | axis.backward(bits);
+            return res;
+        }
+
+        int count_odd_quadrants(const Board& board) noexcept
+        {
+            constexpr std::array<BitBoard, 4> quadrants{
+                0x00000000'0f0f0f0full, 0x00000000'f0f0f0f0ull, 0x0f0f0f0f'00000000ull, 0xf0f0f0f0'00000000ull};
+            const BitBoard empty = ~(board.black | board.white);
+            int res = 0;
+            for (const auto quadrant : quadrants)
+                res += std::popcount(empty & quadrant) & 1;
+            return res;
+        }
+    } // namespace
+
+    BitBoard find_stable_disks(const BitBoard self, const BitBoard opponent) noexcept
+    {
+        std::array<BitBoard, axes.size()> safe{};
+        for (std::size_t i = 0; i < axes.size(); i++)
+            safe[i] = find_full_lines(self | opponent, axes[i]) | axes[i].edges;
+        // Grows monotonically from the disks that are safe without stable neighbors, like the corners
+        BitBoard stable = 0;
+        while (true)
+        {
+            BitBoard next = self;
+            for (std::size_t i = 0; i < axes.size(); i++)
+                next &= safe[i] | axes[i].forward(stable) | axes[i].backward(stable);
+            if (next == stable)
+                return stable;
+            stable = next;
+        }
+    }
+
+    int scalar_feature_value(const ScalarFeature feature, const Board& board) noexcept
+    {
+        const BitBoard empty = ~(board.black | board.white);
+        switch (feature)
+        {
+            case ScalarFeature::mobility: return std::popcount(board.find_legal_moves(Color::black));
+            case ScalarFeature::opponent_mobility: return std::popcount(board.find_legal_moves(Color::white));
+            case ScalarFeature::potential_mobility: return std::popcount(find_neighbors(board.white) & empty);
+            case ScalarFeature::opponent_potential_mobility: return std::popcount(find_neighbors(board.black) & empty);
+            case ScalarFeature::parity: return count_odd_quadrants(board);
+            case ScalarFeature::stability: return std::popcount(find_stable_disks(board.black, board.white));
+            case ScalarFeature::opponent_stability: return std::popcount(find_stable_disks(board.white, board.black));
+        }
+        return 0;
+    }
+} // namespace flr
@@ -0,0 +1,13 @@
+#include "fluorine/evaluation/static_pattern_evaluator.h"
+
+#include "midgame_searcher_impl.h"
+
+namespace flr
+{
+    // Instantiated here so that the standard patterns are compiled with the flags of the library, and so that
+    // evaluate can be inlined into the search
+    template class FLUORINE_API StaticPatternEvaluator<standard_patterns[0], standard_patterns[1],
+        standard_patterns[2], standard_patterns[3], standard_patterns[4], standard_patterns[5], standard_patterns[6],
+        standard_patterns[7], standard_patterns[8], standard_patterns[9], standard_patterns[10]>;
+    template class FLUORINE_API BasicMidgameSearcher<StandardPatternEvaluator>;
+} // namespace flr
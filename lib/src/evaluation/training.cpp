@@ -77,7 +77,7 @@ namespace flr
                             static_cast<int>(cell_count) - totals <= opt_.endgame_solve_depth)
                         {
                             const std::size_t middle_size = local.size();
-                            const auto [_, score, move] = solver.solve(state);
+                            const int score = solver.solve(state).score;
                             local.emplace_back(state.canonical_board(), static_cast<float>(score));
                             std::ranges::transform(solver.transposition_table().entries(), std::back_inserter(local),
                                 [](const std::pair<Board, Bounds<int>>& pair) noexcept -> DataPoint
@@ -100,11 +100,16 @@ namespace flr
                         }
                         else
                         {
-                            const auto [_, score, move] = searcher.search(state, *eval_, opt_.midgame_search_depth);
-                            local.emplace_back(state.canonical_board(), score);
-                            std::ranges::copy(searcher.transposition_table().entries(), std::back_inserter(local));
+                            const auto res = searcher.search(state, *eval_, opt_.midgame_search_depth);
+                            local.emplace_back(state.canonical_board(), res.score);
+                            std::ranges::transform(searcher.transposition_table().entries(), std::back_inserter(local),
+                                [](const std::pair<Board, Bounds<FixedScore>>& pair) noexcept -> DataPoint
+                                {
+                                    const auto [low, high] = pair.second;
+                                    return {pair.first, {from_fixed_score(low), from_fixed_score(high)}};
+                                });
                             const auto use_rand = totals - 4 < opt_.initial_random_moves || dist(rng);
-                            state.play(use_rand ? RandomPlayer{}.get_move(state) : move);
+                            state.play(use_rand ? RandomPlayer{}.get_move(state) : res.move);
                         }
                     }
                     update_progress(worker_id, local.size() - old_dataset_size);
@@ -156,25 +161,6 @@ namespace flr
                 return hist;
             }
         };
-
-        float calculate_mse(const Dataset& dataset, const Evaluator& eval, const std::size_t batch_size)
-        {
-            const std::size_t size = dataset.size();
-            float total_se = 0.0f;
-            for (std::size_t i = 0; i < size; i += batch_size)
-            {
-                const std::size_t end = std::min(i + batch_size, size);
-                float batch_se = 0.0f;
-                for (std::size_t j = i; j < end; j++)
-                {
-                    const float predicted = eval.evaluate(dataset[j].first);
-                    const float error = dataset[j].second.error(predicted);
-                    batch_se += error * error;
-                }
-                total_se += batch_se;
-            }
-            return total_se / static_cast<float>(size);
-        }
     } // namespace
 
     Dataset generate_dataset_via_self_play(const Evaluator& evaluator, const DataGenerationOptions& options)
@@ -187,14 +173,19 @@ namespace flr
         auto& rng = clu::thread_rng();
         if (options.seed)
             rng.seed(*options.seed);
+        evaluator.configure_training({
+            .threads = options.threads,
+            .parallel_stages = options.parallel_stages,
+            .optimizer = options.optimizer,
+        });
         std::optional<ProgressBar> bar;
         if (options.show_progress)
             bar.emplace("Training", options.epochs);
-        const float initial_mse = calculate_mse(dataset, evaluator, options.batch_size);
+        const auto data = evaluator.prepare_dataset(dataset);
+        const float initial_mse = data->calculate_mse();
         for (std::size_t i = 0; i < options.epochs; i++)
         {
-            std::ranges::shuffle(dataset, rng);
-            const float mse = evaluator.optimize(dataset, options.batch_size, options.learning_rate);
+            const float mse = data->optimize_epoch(options.batch_size, options.learning_rate);
             if (bar)
             {
                 bar->set_message(std::format("MSE: {} -> {}", initial_mse, mse));
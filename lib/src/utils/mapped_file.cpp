@@ -0,0 +1,92 @@
+#include "mapped_file.h"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <Windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+namespace flr
+{
+#ifdef _WIN32
+    MappedFile::MappedFile(const std::filesystem::path& path)
+    {
+        file_ = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file_ == INVALID_HANDLE_VALUE)
+            throw std::runtime_error("Failed to open the file to map");
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file_, &size))
+        {
+            CloseHandle(file_);
+            throw std::runtime_error("Failed to get the size of the file to map");
+        }
+        size_ = static_cast<std::size_t>(size.QuadPart);
+        if (size_ == 0) // Empty files cannot be mapped
+            return;
+        mapping_ = CreateFileMappingW(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping_ == nullptr)
+        {
+            CloseHandle(file_);
+            throw std::runtime_error("Failed to map the file");
+        }
+        data_ = static_cast<const std::byte*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+        if (data_ == nullptr)
+        {
+            CloseHandle(mapping_);
+            CloseHandle(file_);
+            throw std::runtime_error("Failed to map the file");
+        }
+    }
+
+    MappedFile::~MappedFile() noexcept
+    {
+        if (data_)
+            UnmapViewOfFile(data_);
+        if (mapping_)
+            CloseHandle(mapping_);
+        CloseHandle(file_);
+    }
+#else
+    MappedFile::MappedFile(const std::filesystem::path& path)
+    {
+        const int fd = open(path.c_str(), O_RDONLY); // NOLINT(cppcoreguidelines-pro-type-vararg)
+        if (fd == -1)
+            throw std::runtime_error("Failed to open the file to map");
+        struct stat info{};
+        if (fstat(fd, &info) == -1)
+        {
+            close(fd);
+            throw std::runtime_error("Failed to get the size of the file to map");
+        }
+        size_ = static_cast<std::size_t>(info.st_size);
+        if (size_ == 0) // Empty files cannot be mapped
+        {
+            close(fd);
+            return;
+        }
+        void* data = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd); // The mapping stays valid after closing the file
+        if (data == MAP_FAILED) // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
+            throw std::runtime_error("Failed to map the file");
+        data_ = static_cast<const std::byte*>(data);
+    }
+
+    MappedFile::~MappedFile() noexcept
+    {
+        if (data_)
+            munmap(const_cast<std::byte*>(data_), size_);
+    }
+#endif
+} // namespace flr
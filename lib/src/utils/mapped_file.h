@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <span>
+
+namespace flr
+{
+    // Read-only memory mapping of a whole file
+    class MappedFile
+    {
+    public:
+        explicit MappedFile(const std::filesystem::path& path);
+        ~MappedFile() noexcept;
+        MappedFile(const MappedFile&) = delete;
+        MappedFile(MappedFile&&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+        MappedFile& operator=(MappedFile&&) = delete;
+
+        [[nodiscard]] std::span<const std::byte> bytes() const noexcept { return {data_, size_}; }
+
+    private:
+        const std::byte* data_ = nullptr;
+        std::size_t size_ = 0;
+#ifdef _WIN32
+        void* file_ = nullptr;
+        void* mapping_ = nullptr;
+#endif
+    };
+} // namespace flr
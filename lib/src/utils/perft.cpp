@@ -1,6 +1,6 @@
 #include "fluorine/utils/perft.h"
 #include "fluorine/core/game.h"
-#include "bit.h"
+#include "fluorine/utils/bit.h"
 
 namespace flr
 {
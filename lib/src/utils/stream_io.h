@@ -0,0 +1,24 @@
+#pragma once
+
+#include <istream>
+#include <ostream>
+#include <type_traits>
+
+namespace flr
+{
+    template <typename T>
+        requires std::is_trivial_v<T>
+    T read(std::istream& stream)
+    {
+        T value;
+        stream.read(reinterpret_cast<char*>(&value), sizeof(T));
+        return value;
+    }
+
+    template <typename T>
+        requires std::is_trivial_v<T>
+    void write(std::ostream& stream, const T& value)
+    {
+        stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+} // namespace flr
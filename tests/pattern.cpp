@@ -0,0 +1,93 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <random>
+#include <set>
+#include <fluorine/evaluation/pattern.h>
+
+namespace
+{
+    using flr::BitBoard;
+    using flr::PatternExtractor;
+
+    // Segments of 2 to 8 adjacent squares along the rows, the columns and both diagonals
+    std::set<BitBoard> line_segments()
+    {
+        std::set<BitBoard> res;
+        constexpr int directions[][2] = {{1, 0}, {0, 1}, {1, 1}, {-1, 1}};
+        for (const auto [dx, dy] : directions)
+            for (int x = 0; x < 8; x++)
+                for (int y = 0; y < 8; y++)
+                {
+                    BitBoard segment = 0;
+                    for (int cx = x, cy = y; cx >= 0 && cx < 8 && cy < 8; cx += dx, cy += dy)
+                    {
+                        segment |= BitBoard{1} << (cy * 8 + cx);
+                        if (std::popcount(segment) >= 2)
+                            res.insert(flr::find_pattern_canonical_form(segment));
+                    }
+                }
+        return res;
+    }
+
+    // The ternary index must match the pext one for every subset of the pattern taken by either color, with the
+    // rest of the pattern taken by the other color, and with random disks outside of the pattern
+    void check_extractor(const PatternExtractor& extractor, std::mt19937_64& rng)
+    {
+        const BitBoard mask = extractor.mask();
+        const int size = std::popcount(mask);
+        for (BitBoard subset = 0; subset < (BitBoard{1} << size); subset++)
+        {
+            const BitBoard bits = flr::bit_expandr(subset, mask);
+            const BitBoard outside = rng() & ~mask;
+            const flr::Board boards[] = {
+                {bits, 0},
+                {0, bits},
+                {bits | (outside & 0x5555555555555555ull), (mask & ~bits) | (outside & 0xaaaaaaaaaaaaaaaaull)},
+            };
+            for (const auto board : boards)
+                REQUIRE(extractor(board) == flr::extract_pattern(board, mask));
+        }
+    }
+} // namespace
+
+// The squares of this pattern have to move down to their reversed positions, which used to be a negative shift
+static_assert(PatternExtractor(flr::find_pattern_canonical_form(0x01020408102040c0ull), false).method() ==
+    PatternExtractor::Method::runs);
+
+TEST_CASE("pattern extraction without pext", "[pattern]")
+{
+    std::mt19937_64 rng(42);
+
+    SECTION("line segments use a magic multiplication")
+    {
+        for (const BitBoard segment : line_segments())
+        {
+            const PatternExtractor extractor(segment, false);
+            CHECK(extractor.method() == PatternExtractor::Method::multiply);
+            check_extractor(extractor, rng);
+        }
+    }
+
+    SECTION("line segments with another square")
+    {
+        std::set<BitBoard> patterns;
+        for (const BitBoard segment : line_segments())
+            for (int square = 0; square < 64; square++)
+                if (const BitBoard extra = BitBoard{1} << square; (segment & extra) == 0)
+                    patterns.insert(flr::find_pattern_canonical_form(segment | extra));
+        for (const BitBoard pattern : patterns)
+            check_extractor(PatternExtractor(pattern, false), rng);
+    }
+
+    SECTION("random patterns")
+    {
+        for (int i = 0; i < 2000; i++)
+        {
+            BitBoard pattern = 0;
+            const auto size = static_cast<int>(rng() % flr::max_pattern_size) + 1;
+            while (std::popcount(pattern) < size)
+                pattern |= BitBoard{1} << (rng() % 64);
+            check_extractor(PatternExtractor(flr::find_pattern_canonical_form(pattern), false), rng);
+        }
+    }
+}